@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using Bitset = std::vector<std::uint64_t>; // Bit i is word i / 64, bit i % 64
+
+inline const std::size_t bitset_words(const std::size_t bit_count) {
+	return (bit_count + 63) / 64;
+}
+
+inline const bool test_bit(const Bitset& bits, const std::size_t i) {
+	return (bits.at(i / 64) >> (i % 64)) & 1;
+}
+
+inline void set_bit(Bitset& bits, const std::size_t i) {
+	bits.at(i / 64) |= std::uint64_t{ 1 } << (i % 64);
+}
+
+inline void clear_bit(Bitset& bits, const std::size_t i) {
+	bits.at(i / 64) &= ~(std::uint64_t{ 1 } << (i % 64));
+}
+
+inline const int lowest_set_bit(const std::uint64_t word) {
+	// word must not be 0
+#if defined(__GNUC__) || defined(__clang__)
+	return __builtin_ctzll(word);
+#else
+	int bit{ 0 };
+	while (((word >> bit) & 1) == 0) {
+		++bit;
+	}
+	return bit;
+#endif
+}
@@ -1,9 +1,12 @@
 #pragma once
 
 #include "settings.h"
+#include "compact_note.h"
+#include "exception.h"
 
 #include "mx/api/ScoreData.h"
 
+#include <memory>
 #include <vector>
 
 using Voice = std::vector<mx::api::NoteData>;
@@ -13,21 +16,85 @@ struct Message {
 	int sonority_2_index{};
 };
 
+struct Shift {
+	int h_shift{}; // In ticks
+	int v_shift{}; // Diatonic steps
+
+	const bool operator==(const Shift& other) const {
+		return h_shift == other.h_shift && v_shift == other.v_shift;
+	}
+};
+
+// One voice of a canon: the shared, immutable notes of the leader or a cached follower, plus the measure-long
+// rests that pad it to the length of the voices added after it. Copying a voice copies a pointer, not its notes
+class CanonVoice {
+public:
+	CanonVoice() = default;
+	CanonVoice(std::shared_ptr<const CompactVoice> notes, const CompactNote& padding_rest)
+		: m_notes{ std::move(notes) }, m_padding_rest{ padding_rest } {
+	}
+
+	const std::size_t size() const {
+		return m_notes->size() + m_padding_measures;
+	}
+
+	const CompactNote& at(const std::size_t index) const {
+		if (index < m_notes->size()) {
+			return (*m_notes)[index];
+		}
+		if (index < size()) {
+			return m_padding_rest;
+		}
+		throw Exception{ "Note index out of range!" };
+	}
+
+	const CompactVoice& get_notes() const {
+		return *m_notes; // Without the padding
+	}
+
+	const CompactNote& get_padding_rest() const {
+		return m_padding_rest;
+	}
+
+	const int get_padding_measures() const {
+		return m_padding_measures;
+	}
+
+	void pad(const int measures) {
+		m_padding_measures += measures;
+	}
+
+private:
+	std::shared_ptr<const CompactVoice> m_notes{ std::make_shared<const CompactVoice>() };
+	CompactNote m_padding_rest{};
+	int m_padding_measures{ 0 };
+};
+
 class Canon {
 public:
-	Canon(const std::vector<Voice> texture, const int max_h_shift, const double max_h_shift_proportion)
+	Canon(const std::vector<CanonVoice>& texture, const std::vector<Shift>& shifts, const int max_h_shift, const double max_h_shift_proportion)
 		: m_texture{ texture },
+		m_shifts{ shifts },
 		m_max_h_shift{ max_h_shift },
 		m_max_h_shift_proportion{ max_h_shift_proportion },
 		m_voice_count{ static_cast<int>(texture.size())} {
 	}
 
-	std::vector<Voice>& texture() {
+	std::vector<CanonVoice>& texture() {
 		return m_texture; // Can't change texture size
 	}
 
-	void add_voice(const Voice& voice) {
+	const std::vector<CanonVoice>& get_texture() const {
+		return m_texture;
+	}
+
+	const std::vector<Shift>& get_shifts() const {
+		return m_shifts; // Parallel to texture. The leader is Shift{ 0, 0 }
+	}
+
+	void add_voice(const CanonVoice& voice, const Shift& shift) {
 		m_texture.emplace_back(voice);
+		m_shifts.emplace_back(shift);
 		++m_voice_count;
 		m_total_voice_pairs = m_voice_count * (m_voice_count - 1) / 2;
 	}
@@ -152,7 +219,8 @@ public:
 	}
 
 private:
-	std::vector<Voice> m_texture{};
+	std::vector<CanonVoice> m_texture{}; // What the checker sees. Output notes are rebuilt from the leader and m_shifts
+	std::vector<Shift> m_shifts{};
 	int m_voice_count{};
 	int m_max_h_shift{}; // Also tightness
 	double m_max_h_shift_proportion{}; // Also tightness
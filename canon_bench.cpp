@@ -0,0 +1,320 @@
+#include "canon_generator.h"
+#include "file_reader.h"
+#include "file_writer.h"
+#include "exception.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+// Times the generator's hot paths over synthetic subjects of different lengths, meters and voice counts. Every
+// row reports throughput and heap allocations per operation, so a regression in either shows up as a jump in
+// one row. Single-threaded, so the numbers are comparable between machines with different core counts.
+//   canon_bench [--min-time <seconds per row>]
+
+std::atomic<std::uint64_t> allocation_count{ 0 };
+std::atomic<std::uint64_t> allocated_bytes{ 0 };
+
+void* operator new(std::size_t size) {
+	allocation_count.fetch_add(1, std::memory_order_relaxed);
+	allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+	if (void* pointer{ std::malloc(size == 0 ? 1 : size) }) {
+		return pointer;
+	}
+	throw std::bad_alloc{};
+}
+
+// Kept out of line: GCC can't tell these operators are the replacements above, so once one is inlined next to a
+// new expression it warns that free() doesn't match operator new (-Wmismatched-new-delete)
+#if defined(_MSC_VER)
+#define BENCH_NOINLINE __declspec(noinline)
+#else
+#define BENCH_NOINLINE __attribute__((noinline))
+#endif
+
+BENCH_NOINLINE void operator delete(void* pointer) noexcept {
+	std::free(pointer);
+}
+
+BENCH_NOINLINE void operator delete(void* pointer, std::size_t) noexcept {
+	std::free(pointer);
+}
+
+struct Meter {
+	int beats{};
+	int beat_type{};
+};
+
+const std::string synthetic_subject_xml(const int measures, const Meter& meter, unsigned int seed) {
+	// A stepwise C major melody with one note per beat unit or so, starting and ending on C. Divisions are 4 per
+	// quarter like the sample files, so an eighth is 2 ticks. Same seed, same subject
+	const auto next_random{ [&](const int bound) {
+		seed = seed * 1103515245u + 12345u;
+		return static_cast<int>((seed >> 16) % static_cast<unsigned int>(bound));
+	} };
+
+	const int ticks_per_measure{ meter.beats * 16 / meter.beat_type };
+	const std::vector<int> durations{ (meter.beat_type == 8) ? std::vector<int>{ 2, 4, 6 } : std::vector<int>{ 2, 4, 8 } };
+	const std::string steps{ "CDEFGAB" };
+
+	std::string xml{
+		"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<!DOCTYPE score-partwise PUBLIC \"-//Recordare//DTD MusicXML 4.0 Partwise//EN\" \"http://www.musicxml.org/dtds/partwise.dtd\">\n"
+		"<score-partwise version=\"4.0\">\n"
+		"<part-list><score-part id=\"P1\"><part-name>Subject</part-name></score-part></part-list>\n"
+		"<part id=\"P1\">\n"
+	};
+
+	int diatonic_index{ 7 * 4 }; // C4
+	for (int measure{ 0 }; measure < measures; ++measure) {
+		xml += "<measure number=\"" + std::to_string(measure + 1) + "\">\n";
+		if (measure == 0) {
+			xml += "<attributes><divisions>4</divisions><key><fifths>0</fifths></key><time><beats>" + std::to_string(meter.beats)
+				+ "</beats><beat-type>" + std::to_string(meter.beat_type) + "</beat-type></time><clef><sign>G</sign><line>2</line></clef></attributes>\n";
+		}
+
+		for (int ticks_left{ ticks_per_measure }; ticks_left > 0;) {
+			int duration{ durations.at(next_random(static_cast<int>(durations.size()))) };
+			while (duration > ticks_left) {
+				duration = durations.at(0);
+			}
+			ticks_left -= duration;
+
+			const bool is_last_note{ measure == measures - 1 && ticks_left == 0 };
+			if (is_last_note) {
+				diatonic_index = 7 * 4;
+			}
+			else if (measure > 0 || ticks_left < ticks_per_measure - duration) {
+				const int step{ next_random(5) - 2 }; // -2 to 2 steps, kept within C4..C5
+				diatonic_index = std::clamp(diatonic_index + ((step == 0) ? 1 : step), 7 * 4, 7 * 5);
+			}
+
+			const std::string type{ (duration == 2) ? "eighth" : (duration == 8) ? "half" : "quarter" };
+			xml += "<note><pitch><step>" + std::string{ steps.at(diatonic_index % 7) } + "</step><octave>" + std::to_string(diatonic_index / 7)
+				+ "</octave></pitch><duration>" + std::to_string(duration) + "</duration><voice>1</voice><type>" + type + "</type>"
+				+ ((duration == 6) ? "<dot/>" : "") + "</note>\n";
+		}
+		xml += "</measure>\n";
+	}
+
+	xml += "</part>\n</score-partwise>\n";
+	return xml;
+}
+
+struct Subject {
+	mx::api::ScoreData score{};
+	Voice leader{};
+	SubjectData data{};
+	SearchSetup setup{}; // The same as generate_canons derives from the subject
+};
+
+const Subject create_subject(const mx::api::ScoreData& score) {
+	const SubjectData data{ get_subject(score) };
+	return Subject{ score, create_voice_array(score), data, create_search_setup(data, false) };
+}
+
+struct Measurement {
+	double seconds_per_op{};
+	double allocations_per_op{};
+	double bytes_per_op{};
+};
+
+template <typename SetupFunction, typename RunFunction>
+const Measurement measure(const double min_seconds, const SetupFunction& setup, const RunFunction& run) {
+	// Repeats setup() untimed and run(state) timed until min_seconds of run() time add up
+	double seconds{ 0 };
+	std::uint64_t allocations{ 0 };
+	std::uint64_t bytes{ 0 };
+	int ops{ 0 };
+	do {
+		auto state{ setup() };
+		const std::uint64_t allocations_before{ allocation_count.load(std::memory_order_relaxed) };
+		const std::uint64_t bytes_before{ allocated_bytes.load(std::memory_order_relaxed) };
+		const std::chrono::steady_clock::time_point start{ std::chrono::steady_clock::now() };
+		run(state);
+		seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		allocations += allocation_count.load(std::memory_order_relaxed) - allocations_before;
+		bytes += allocated_bytes.load(std::memory_order_relaxed) - bytes_before;
+		++ops;
+	} while (seconds < min_seconds);
+
+	return Measurement{ seconds / ops, static_cast<double>(allocations) / ops, static_cast<double>(bytes) / ops };
+}
+
+void print_row(const std::string& stage, const std::string& subject_name, const std::size_t items_per_op, const std::string& item_name, const Measurement& measurement) {
+	std::cout << std::left << std::setw(30) << stage << std::setw(16) << subject_name
+		<< std::right << std::fixed << std::setprecision(1)
+		<< std::setw(14) << measurement.seconds_per_op * 1e6 << " us/op"
+		<< std::setw(14) << items_per_op / measurement.seconds_per_op << ' ' << std::left << std::setw(12) << (item_name + "/s")
+		<< std::right << std::setw(12) << measurement.allocations_per_op << " allocs/op"
+		<< std::setw(12) << measurement.bytes_per_op / 1024 << " KiB/op\n";
+}
+
+const Settings bench_settings(const int voices) {
+	Settings settings{};
+	settings.max_voices = voices;
+	settings.threads = 1;
+	return settings;
+}
+
+std::vector<Canon> generate_canons_up_to(const Subject& subject, const int voices, PairCache& pair_cache) {
+	// All canons with exactly `voices` voices, like the breadth-first search in generate_canons
+	const Settings settings{ bench_settings(voices) };
+	const SearchSetup& setup{ subject.setup };
+	const FollowerCache followers{ subject.data.leader, setup.leader_length_ticks, setup.ticks_per_beat, setup.key_signature, setup.key, false, setup.ticks_per_measure, settings };
+	std::vector<Canon> canons{ Canon{ std::vector<CanonVoice>{ CanonVoice{ followers.get_follower(0, 0), setup.compact_measure_long_rest } }, std::vector<Shift>{ Shift{ 0, 0 } }, 0, 0 } };
+	for (int voice_count{ 2 }; voice_count <= voices && !canons.empty(); ++voice_count) {
+		canons = generate_canons_for_new_voice(canons, followers, setup.leader_length_ticks, setup.ticks_per_measure, setup.ticks_per_beat, setup.rhythmic_hierarchy_array, setup.rhythmic_hierarchy_max_depth, setup.rhythmic_hierarchy_of_beat, setup.key, setup.compact_measure_long_rest, settings, pair_cache);
+	}
+	return canons;
+}
+
+const std::vector<Canon> create_candidates(const Subject& subject, const std::vector<Canon>& template_canons) {
+	// Every follower check_candidate would add to the template canons, before the checker has seen them
+	const Settings settings{ bench_settings(static_cast<int>(template_canons.empty() ? 2 : template_canons.at(0).get_voice_count() + 1)) };
+	const SearchSetup& setup{ subject.setup };
+	const FollowerCache followers{ subject.data.leader, setup.leader_length_ticks, setup.ticks_per_beat, setup.key_signature, setup.key, false, setup.ticks_per_measure, settings };
+
+	std::vector<Canon> candidates{};
+	for (const ShiftTask& task : create_shift_tasks(template_canons, setup.leader_length_ticks, setup.ticks_per_beat, settings)) {
+		candidates.emplace_back(create_candidate(template_canons.at(task.template_index), task.h_shift, task.v_shift, followers, setup.leader_length_ticks, setup.ticks_per_measure, setup.compact_measure_long_rest));
+	}
+	return candidates;
+}
+
+void bench_input(const std::string& subject_name, const std::string& xml, const double min_seconds) {
+	// Reading what the search needs from the input, through the full mx document and through the fast path
+	const Measurement parsed{ measure(min_seconds, []() { return 0; }, [&](int&) {
+		const SubjectData subject{ get_subject(get_score_object(xml)) };
+	}) };
+	print_row("get_score_object", subject_name, 1, "subjects", parsed);
+
+	const Measurement read{ measure(min_seconds, []() { return 0; }, [&](int&) {
+		const InputScore input{ read_input_string(xml) };
+	}) };
+	print_row("read_input_string", subject_name, 1, "subjects", read);
+}
+
+void bench_subject(const std::string& subject_name, const Subject& subject, const int voices, const double min_seconds, const std::filesystem::path& output_path) {
+	const std::string name{ subject_name + ' ' + std::to_string(voices) + 'v' };
+
+	if (voices == 2) {
+		// Voice count doesn't change these
+		const Measurement voice_array{ measure(min_seconds, []() { return 0; }, [&](int&) {
+			const Voice leader{ create_voice_array(subject.score) };
+		}) };
+		print_row("create_voice_array", subject_name, subject.leader.size(), "notes", voice_array);
+
+		std::vector<Shift> shifts{};
+		for (int h_shift{ subject.setup.ticks_per_beat }; h_shift < subject.setup.leader_length_ticks * 0.8; h_shift += subject.setup.ticks_per_beat) {
+			for (int v_shift{ 0 }; v_shift >= -6; --v_shift) {
+				shifts.emplace_back(Shift{ h_shift, v_shift });
+			}
+		}
+		const Measurement shifted{ measure(min_seconds, []() { return 0; }, [&](int&) {
+			for (const Shift& follower : shifts) {
+				const CompactVoice voice{ shift(subject.data.leader, follower.v_shift, follower.h_shift, subject.setup.key_signature, subject.setup.key, false, subject.setup.ticks_per_measure) };
+			}
+		}) };
+		print_row("shift", subject_name, shifts.size(), "followers", shifted);
+	}
+
+	// Candidates with `voices` voices, checked with a cold pair cache like the first time a run sees them
+	PairCache warm_pair_cache{};
+	const std::vector<Canon> template_canons{ generate_canons_up_to(subject, voices - 1, warm_pair_cache) };
+	const std::vector<Canon> candidates{ create_candidates(subject, template_canons) };
+	const Measurement checked{ measure(min_seconds, [&]() { return std::make_pair(candidates, std::make_unique<PairCache>()); }, [&](std::pair<std::vector<Canon>, std::unique_ptr<PairCache>>& state) {
+		const Settings settings{ bench_settings(voices) };
+		for (Canon& canon : state.first) {
+			check_counterpoint(canon, subject.setup.ticks_per_measure, subject.setup.key, subject.setup.rhythmic_hierarchy_array, subject.setup.rhythmic_hierarchy_max_depth, subject.setup.rhythmic_hierarchy_of_beat, settings, *state.second);
+		}
+	}) };
+	print_row("check_counterpoint", name, candidates.size(), "candidates", checked);
+
+	std::size_t canon_count{ 0 };
+	const Measurement generated{ measure(min_seconds, []() { return std::make_unique<PairCache>(); }, [&](std::unique_ptr<PairCache>& pair_cache) {
+		canon_count = generate_canons_up_to(subject, voices, *pair_cache).size();
+	}) };
+	print_row("generate_canons_for_new_voice", name, std::max<std::size_t>(canon_count, 1), "canons", generated);
+
+	// Output of the first canon found, or of the leader with empty voices if there is none
+	const std::vector<Canon> canons{ generate_canons_up_to(subject, voices, warm_pair_cache) };
+	std::vector<Voice> realized_voices{};
+	for (int i{ 0 }; i < voices; ++i) {
+		if (!canons.empty()) {
+			realized_voices.emplace_back(realize_voice(canons.at(0), i, subject.leader, subject.setup.key_signature, subject.setup.key, false, subject.setup.ticks_per_measure, subject.setup.time_signature, subject.setup.measure_long_rest));
+		}
+		else {
+			realized_voices.emplace_back(Voice(2 * subject.setup.leader_length_measures, subject.setup.measure_long_rest));
+		}
+	}
+
+	std::vector<mx::api::PartData> parts{};
+	const Measurement parted{ measure(min_seconds, []() { return 0; }, [&](int&) {
+		parts.clear();
+		for (const Voice& voice : realized_voices) {
+			parts.emplace_back(voice_array_to_part(subject.score, voice, subject.setup.ticks_per_measure, subject.setup.time_signature, subject.setup.measure_long_rest, subject.setup.leader_length_measures));
+		}
+	}) };
+	print_row("voice_array_to_part", name, parts.size(), "parts", parted);
+
+	const mx::api::ScoreData output_score{ create_output_score(subject.score, parts) };
+	const Measurement written{ measure(min_seconds, []() { return 0; }, [&](int&) {
+		write_file(output_score, output_path.string());
+	}) };
+	print_row("write_file", name, 1, "files", written);
+
+	const std::filesystem::path mxl_path{ std::filesystem::path{ output_path }.replace_extension(".mxl") };
+	const Measurement compressed{ measure(min_seconds, []() { return 0; }, [&](int&) {
+		write_file(output_score, mxl_path.string());
+	}) };
+	print_row("write_file (.mxl)", name, 1, "files", compressed);
+	std::filesystem::remove(mxl_path);
+}
+
+int main(int argc, char* argv[]) {
+	double min_seconds{ 0.2 };
+	for (int i{ 1 }; i < argc; ++i) {
+		const std::string option{ argv[i] };
+		if (option == "--min-time" && i + 1 < argc) {
+			min_seconds = std::stod(argv[++i]);
+		}
+		else {
+			std::cerr << "usage: canon_bench [--min-time <seconds per row>]\n";
+			return 1;
+		}
+	}
+
+	const std::filesystem::path output_path{ std::filesystem::temp_directory_path() / "canon_bench.musicxml" };
+	const std::vector<std::pair<std::string, Meter>> meters{ { "4/4", Meter{ 4, 4 } }, { "3/4", Meter{ 3, 4 } }, { "6/8", Meter{ 6, 8 } } };
+
+	try {
+		for (const int measures : { 2, 4, 8 }) {
+			for (const std::pair<std::string, Meter>& meter : meters) {
+				const std::string subject_name{ std::to_string(measures) + "m " + meter.first };
+				const std::string xml{ synthetic_subject_xml(measures, meter.second, static_cast<unsigned int>(measures * 31 + meter.second.beats)) };
+				bench_input(subject_name, xml, min_seconds);
+				const Subject subject{ create_subject(get_score_object(xml)) };
+				for (const int voices : { 2, 3 }) {
+					bench_subject(subject_name, subject, voices, min_seconds, output_path);
+				}
+			}
+		}
+	}
+	catch (const Exception& exception) {
+		std::cout << exception.getError();
+		return 1;
+	}
+
+	std::filesystem::remove(output_path);
+	return 0;
+}
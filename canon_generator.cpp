@@ -1,11 +1,16 @@
 
+#include "canon_generator.h"
 #include "exception.h"
 #include "settings.h"
 #include "file_reader.h"
 #include "file_writer.h"
 #include "sonority.h"
 #include "canon.h"
+#include "compact_note.h"
 #include "counterpoint_checker.h"
+#include "pair_cache.h"
+#include "parallel.h"
+#include "checker_stats.h"
 
 #include "mx/api/ScoreData.h"
 
@@ -17,12 +22,15 @@
 #include <cmath>
 #include <algorithm>
 #include <functional>
+#include <optional>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <mutex>
 
 //#define DEBUG
 //#define SINGLE_SHIFT_CHECK
 
-using Voice = std::vector<mx::api::NoteData>; // Condensed voice in terminology from create_voice_array()
-
 const std::vector<int> alters_by_key(const int fifths) {
 	std::vector<int> alters_array{ 0, 0, 0, 0, 0, 0, 0 };
 
@@ -242,44 +250,48 @@ const Voice split_rests(const int ticks, const int tick_time_position, const int
 	return splitted_rests;
 }
 
-const Voice shift(Voice voice, const int v_shift, const int h_shift, const std::vector<int>& key_signature, const Key& key, const bool minor_key, const int ticks_per_measure, const mx::api::TimeSignatureData& time_signature) { // h_shift in ticks. voice is explicitly a copy	
-	// Vertical shift
-	if (v_shift != 0) {
-		for (mx::api::NoteData& note : voice) {
-			// Diatonic transpose
-			if (v_shift < -6 || v_shift > 6) {
-				throw Exception{ "Vertical shift must be between -6 and 6! " + std::to_string(v_shift) + " is illegal.\n" };
-			}
+void transpose_pitch(mx::api::PitchData& pitch, const int v_shift, const std::vector<int>& key_signature, const Key& key, const bool minor_key) {
+	// Diatonic transpose
+	if (v_shift < -6 || v_shift > 6) {
+		throw Exception{ "Vertical shift must be between -6 and 6! " + std::to_string(v_shift) + " is illegal.\n" };
+	}
 
-			note.pitchData.alter = note.pitchData.alter - key_signature.at(static_cast<int>(note.pitchData.step)); // Apply extra accidentals (in addition to key signature)
+	pitch.alter = pitch.alter - key_signature.at(static_cast<int>(pitch.step)); // Apply extra accidentals (in addition to key signature)
 
-			if (minor_key && (note.pitchData.step == key.leading_tone.step) && (note.pitchData.alter == key.leading_tone.alter)) {
-				// If minor key note is the 7th
-				note.pitchData.alter -= 1; // Override normal accidental preservation
-			}
+	if (minor_key && (pitch.step == key.leading_tone.step) && (pitch.alter == key.leading_tone.alter)) {
+		// If minor key note is the 7th
+		pitch.alter -= 1; // Override normal accidental preservation
+	}
 
-			const int destination_int_pre_mod{ static_cast<int>(note.pitchData.step) + v_shift };
-			if (v_shift > 0) {
-				note.pitchData.step = static_cast<mx::api::Step>(destination_int_pre_mod % 7);
-				if (destination_int_pre_mod > 6) {
-					++note.pitchData.octave;
-				}
-			}
-			else if (v_shift < 0) {
-				note.pitchData.step = static_cast<mx::api::Step>((destination_int_pre_mod + 21) % 7); // Adjust the 21 based on max number of extra octaves
-				if (destination_int_pre_mod < 0) { // 6?
-					--note.pitchData.octave;
-				}
-			}
+	const int destination_int_pre_mod{ static_cast<int>(pitch.step) + v_shift };
+	if (v_shift > 0) {
+		pitch.step = static_cast<mx::api::Step>(destination_int_pre_mod % 7);
+		if (destination_int_pre_mod > 6) {
+			++pitch.octave;
+		}
+	}
+	else if (v_shift < 0) {
+		pitch.step = static_cast<mx::api::Step>((destination_int_pre_mod + 21) % 7); // Adjust the 21 based on max number of extra octaves
+		if (destination_int_pre_mod < 0) { // 6?
+			--pitch.octave;
+		}
+	}
 
-			// Key signature
-			if (minor_key && (note.pitchData.step == key.leading_tone.step)) {
-				// If minor key note is the 7th
-				note.pitchData.alter += key_signature.at(static_cast<int>(note.pitchData.step)) + 1; // Override normal accidental preservation
-			}
-			else {
-				note.pitchData.alter += key_signature.at(static_cast<int>(note.pitchData.step));
-			}
+	// Key signature
+	if (minor_key && (pitch.step == key.leading_tone.step)) {
+		// If minor key note is the 7th
+		pitch.alter += key_signature.at(static_cast<int>(pitch.step)) + 1; // Override normal accidental preservation
+	}
+	else {
+		pitch.alter += key_signature.at(static_cast<int>(pitch.step));
+	}
+}
+
+const Voice shift(Voice voice, const int v_shift, const int h_shift, const std::vector<int>& key_signature, const Key& key, const bool minor_key, const int ticks_per_measure, const mx::api::TimeSignatureData& time_signature) { // h_shift in ticks. voice is explicitly a copy	
+	// Vertical shift
+	if (v_shift != 0) {
+		for (mx::api::NoteData& note : voice) {
+			transpose_pitch(note.pitchData, v_shift, key_signature, key, minor_key);
 		}
 	}
 
@@ -308,6 +320,61 @@ const Voice shift(Voice voice, const int v_shift, const int h_shift, const std::
 	return voice;
 }
 
+const CompactVoice shift(const CompactVoice& voice, const int v_shift, const int h_shift, const std::vector<int>& key_signature, const Key& key, const bool minor_key, const int ticks_per_measure) {
+	// Same notes as the Voice version, for the checker. Rests don't need to be split into notatable durations here
+	CompactVoice output{};
+	output.reserve(voice.size() + 2);
+
+	if (h_shift != 0) {
+		output.emplace_back(compact_rest(h_shift));
+	}
+
+	for (CompactNote note : voice) {
+		if (v_shift != 0) {
+			mx::api::PitchData pitch{ note.get_pitch_data() };
+			transpose_pitch(pitch, v_shift, key_signature, key, minor_key);
+			note.set_pitch(pitch);
+		}
+		output.emplace_back(note);
+	}
+
+	if (h_shift != 0) {
+		output.emplace_back(compact_rest(ticks_per_measure - h_shift % ticks_per_measure));
+	}
+
+	return output;
+}
+
+FollowerCache::FollowerCache(const CompactVoice& leader, const int leader_length_ticks, const int ticks_per_beat, const std::vector<int>& key_signature, const Key& key, const bool minor_key, const int ticks_per_measure, const Settings& settings)
+	: m_h_shift_increment{ std::max(1, ticks_per_beat / settings.h_shift_increments_per_beat) } {
+	// Same h_shifts as the search loops, plus h_shift 0 for the leader itself
+	for (int h_shift{ 0 }; h_shift < leader_length_ticks * settings.h_shift_limit || h_shift == 0; h_shift += m_h_shift_increment) {
+		for (int v_shift{ 0 }; v_shift >= -6; --v_shift) {
+			m_followers.emplace_back(std::make_shared<const CompactVoice>(shift(leader, v_shift, h_shift, key_signature, key, minor_key, ticks_per_measure)));
+		}
+	}
+}
+
+const std::shared_ptr<const CompactVoice>& FollowerCache::get_follower(const int h_shift, const int v_shift) const {
+	const std::size_t index{ static_cast<std::size_t>(h_shift / m_h_shift_increment * 7 - v_shift) };
+	if (h_shift < 0 || h_shift % m_h_shift_increment != 0 || v_shift > 0 || v_shift < -6 || index >= m_followers.size()) {
+		throw Exception{ "Follower is not in the cache!" };
+	}
+	return m_followers[index];
+}
+
+const Voice realize_voice(const Canon& canon, const int voice_index, const Voice& leader, const std::vector<int>& key_signature, const Key& key, const bool minor_key, const int ticks_per_measure, const mx::api::TimeSignatureData& time_signature, const mx::api::NoteData& measure_long_rest) {
+	// Rebuild the notated voice from its shift, including the empty measures every later voice appended to it
+	const Shift& voice_shift{ canon.get_shifts().at(voice_index) };
+	Voice voice{ shift(leader, voice_shift.v_shift, voice_shift.h_shift, key_signature, key, minor_key, ticks_per_measure, time_signature) };
+	for (int i{ voice_index + 1 }; i < canon.get_shifts().size(); ++i) {
+		for (int j{ 0 }; j < (canon.get_shifts().at(i).h_shift / ticks_per_measure + 1); ++j) {
+			voice.emplace_back(measure_long_rest);
+		}
+	}
+	return voice;
+}
+
 const mx::api::PartData voice_array_to_part(const mx::api::ScoreData& score, Voice voice, const int ticks_per_measure, const mx::api::TimeSignatureData& time_signature, const mx::api::NoteData& measure_long_rest, const int leader_length_measures) {
 	mx::api::PartData part{ score.parts.at(0) }; // Copy
 	part = extend_part_length(part, 2 * leader_length_measures - part.measures.size(), time_signature, measure_long_rest); // TODO: verify time signature doesn't change
@@ -317,24 +384,38 @@ const mx::api::PartData voice_array_to_part(const mx::api::ScoreData& score, Voi
 		measure.staves.at(0).voices.at(0) = mx::api::VoiceData{};
 	}
 
+	// Single forward pass. Notes are read at next_note; the pieces of a note split at a barline wait in
+	// split_notes in REVERSE ORDER, so the next piece is always at the back
+	std::size_t next_note{ 0 };
+	Voice split_notes{};
+	const auto front{ [&]() -> mx::api::NoteData& {
+		return split_notes.empty() ? voice.at(next_note) : split_notes.back();
+	} };
+	const auto pop_front{ [&]() {
+		if (split_notes.empty()) {
+			++next_note;
+		}
+		else {
+			split_notes.pop_back();
+		}
+	} };
+
 	for (int i{ 0 }; i < part.measures.size(); ++i) {
-		for (int j{ 0 }; j < ticks_per_measure;) { // Increment j BEFORE erasing the first voice in array
+		std::vector<mx::api::NoteData>& measure_notes{ part.measures.at(i).staves.at(0).voices.at(0).notes };
+		for (int j{ 0 }; j < ticks_per_measure;) { // Increment j BEFORE taking the note
 			const int ticks_to_barline{ ticks_per_measure - j };
-			if (ticks_to_barline < voice.at(0).durationData.durationTimeTicks) {
-				auto& splitted_notes{ split_note(voice.at(0), ticks_to_barline, ticks_per_measure, time_signature)};
-				voice.erase(voice.begin());
-				while (splitted_notes.size() > 0) {
-					voice.insert(voice.begin(), splitted_notes.back()); // Insert in REVERSE ORDER so first in splitted_notes goes in front
-					splitted_notes.pop_back();
-				}
+			if (ticks_to_barline < front().durationData.durationTimeTicks) {
+				Voice splitted_notes{ split_note(front(), ticks_to_barline, ticks_per_measure, time_signature) };
+				pop_front();
+				split_notes.insert(split_notes.end(), std::make_move_iterator(splitted_notes.rbegin()), std::make_move_iterator(splitted_notes.rend()));
 			}
 
-			j += voice.at(0).durationData.durationTimeTicks;
+			j += front().durationData.durationTimeTicks;
 
-			part.measures.at(i).staves.at(0).voices.at(0).notes.emplace_back(voice.at(0));
-			voice.erase(voice.begin());
+			measure_notes.emplace_back(std::move(front()));
+			pop_front();
 
-			if (voice.size() <= 0) {
+			if (split_notes.empty() && next_note >= voice.size()) {
 				return part;
 			}
 		}
@@ -435,74 +516,137 @@ const ScaleDegree get_tonic(const int fifths, const bool minor_key) {
 	return ScaleDegree{ static_cast<mx::api::Step>(step), alter };
 }
 
-std::vector<Canon> generate_canons_for_new_voice(std::vector<Canon>& template_canons_array, const Voice& leader, const int leader_length_ticks, const int ticks_per_measure, const int ticks_per_beat, const std::vector<int>& rhythmic_hierarchy_array, const int rhythmic_hierarchy_max_depth, const int rhythmic_hierarchy_of_beat, const std::vector<int>& key_signature, const Key& key, const bool minor_key, const mx::api::TimeSignatureData& time_signature, const mx::api::NoteData& measure_long_rest, const Settings& settings) {
-	std::vector<Canon> valid_canons_for_current_voice{};
+Canon create_candidate(const Canon& template_canon, const int h_shift, const int v_shift, const FollowerCache& followers, const int leader_length_ticks, const int ticks_per_measure, const CompactNote& measure_long_rest) {
+	const double max_h_shift_proportion{ static_cast<double>(h_shift) / leader_length_ticks }; // settings.leader_length_ticks
+	Canon canon{ template_canon.get_texture(), template_canon.get_shifts(), h_shift, max_h_shift_proportion };
+	canon.add_voice(CanonVoice{ followers.get_follower(h_shift, v_shift), measure_long_rest }, Shift{ h_shift, v_shift });
 
-	// Maximum h_shift increment because tick sizes are unpredictable for some reason
-	const int h_shift_increment{ std::max(1, ticks_per_beat / settings.h_shift_increments_per_beat) }; // DO THIS ONCE AND DONT LOOP
-	
-	for (Canon& template_canon : template_canons_array) {
-
-#ifndef SINGLE_SHIFT_CHECK
-		for (int h_shift{ template_canon.get_max_h_shift() + h_shift_increment }; h_shift < leader_length_ticks * settings.h_shift_limit; h_shift += h_shift_increment) {
-			// settings.leader_length_ticks
-
-			for (int v_shift{ 0 }; v_shift >= -6; --v_shift) {
-#endif // SINGLE_SHIFT_CHECK
+	// Append empty measures to leader so both voices have the same number of complete measures
+	for (int i{ 0 }; i < canon.texture().size() - 1; ++i) { // Skip last one (follower)
+		canon.texture().at(i).pad(h_shift / ticks_per_measure + 1);
+	}
+	return canon;
+}
 
-#ifdef SINGLE_SHIFT_CHECK
-				const int v_shift{ -1 };
-				const int h_shift{ 12 };
-				if (h_shift > leader_length_ticks) {
-					std::cout << "h_shift is too large\n";
-				}
-#endif // SINGLE_SHIFT_CHECK
+std::optional<Canon> check_candidate(const Canon& template_canon, const int h_shift, const int v_shift, const FollowerCache& followers, const int leader_length_ticks, const int ticks_per_measure, const std::vector<int>& rhythmic_hierarchy_array, const int rhythmic_hierarchy_max_depth, const int rhythmic_hierarchy_of_beat, const Key& key, const CompactNote& measure_long_rest, const Settings& settings, PairCache& pair_cache) {
+	// Adds one follower to template_canon. Returns the new canon if it passes the checker
+	// Create follower (LOOP THIS)
+	// TEMPORARY
+	count_stat(StatCounter::candidates);
+	std::optional<Canon> candidate{};
+	{
+		const StageTimer timer{ Stage::build_candidate };
+		candidate.emplace(create_candidate(template_canon, h_shift, v_shift, followers, leader_length_ticks, ticks_per_measure, measure_long_rest));
+	}
+	Canon& canon{ *candidate };
 
-				// Create follower (LOOP THIS)
-				// TEMPORARY
-				const double max_h_shift_proportion{ static_cast<double>(h_shift) / leader_length_ticks }; // settings.leader_length_ticks
-				Canon canon{ template_canon.texture(), h_shift, max_h_shift_proportion };
-				const Voice follower{ shift(leader, v_shift, h_shift, key_signature, key, minor_key, ticks_per_measure, time_signature) }; // const
-				canon.add_voice(follower);
-
-				// Append empty measures to leader so both voices have the same number of complete measures
-				for (int i{ 0 }; i < canon.texture().size() - 1; ++i) { // Skip last one (follower)
-					for (int j{ 0 }; j < (h_shift / ticks_per_measure + 1); ++j) {
-						canon.texture().at(i).emplace_back(measure_long_rest);
-					}
-				}
+	if (settings.depth_first && !are_new_voice_pairs_viable(canon, ticks_per_measure, key, rhythmic_hierarchy_array, rhythmic_hierarchy_max_depth, rhythmic_hierarchy_of_beat, settings, pair_cache)) {
+		return std::nullopt; // One of the new pairs has no valid inversion, which check_counterpoint would reject too
+	}
 
-				// Check counterpoint
-				check_counterpoint(canon, ticks_per_measure, key, rhythmic_hierarchy_array, rhythmic_hierarchy_max_depth, rhythmic_hierarchy_of_beat, settings);
-				// This will change member variables in canon
+	// Check counterpoint
+	const bool is_valid{ check_counterpoint(canon, ticks_per_measure, key, rhythmic_hierarchy_array, rhythmic_hierarchy_max_depth, rhythmic_hierarchy_of_beat, settings, pair_cache) };
+	// This will change member variables in canon
 
 #ifdef SINGLE_SHIFT_CHECK
-				valid_canons_for_current_voice.emplace_back(Canon{ canon.texture(), h_shift, max_h_shift_proportion });
+	return Canon{ canon.texture(), canon.get_shifts(), h_shift, static_cast<double>(h_shift) / leader_length_ticks };
 #endif // SINGLE_SHIFT_CHECK
 
 #ifndef SINGLE_SHIFT_CHECK
-				//const double score{ errors_count + settings.warning_weight * warnings_count }; // Not sure when you would need to use this
-				if (canon.get_error_count() > 0 || canon.get_warning_count() > settings.warning_threshold) {
+	//const double score{ errors_count + settings.warning_weight * warnings_count }; // Not sure when you would need to use this
+	// A pair with no valid inversion can fail on warnings alone, which leaves no errors in the canon, so the
+	// verdict decides and not the message boxes
+	if (!is_valid || canon.get_error_count() > 0 || canon.get_warning_count() > settings.warning_threshold) {
 #ifdef DEBUG
-					//std::cout << "Canon rejected! At h_shift = " << h_shift << ", v_shift = " << v_shift << "\n\n";
+		//std::cout << "Canon rejected! At h_shift = " << h_shift << ", v_shift = " << v_shift << "\n\n";
 #endif // DEBUG
-					continue;
-					//valid_canons_for_current_voice.emplace_back(Canon{ canon.texture(), h_shift, max_h_shift_proportion });
-				}
-				else {
-					valid_canons_for_current_voice.emplace_back(canon);
+		return std::nullopt;
+	}
+	else {
 #ifdef DEBUG
-					//std::cout << "Valid canon! At h_shift = " << h_shift << ", v_shift = " << v_shift << "\n\n";
+		//std::cout << "Valid canon! At h_shift = " << h_shift << ", v_shift = " << v_shift << "\n\n";
 #endif // DEBUG
-				}
+		count_stat(StatCounter::valid_canons);
+		return candidate;
+	}
+#endif // SINGLE_SHIFT_CHECK
+}
+
+const std::vector<ShiftTask> create_shift_tasks(const std::vector<Canon>& template_canons_array, const int leader_length_ticks, const int ticks_per_beat, const Settings& settings) {
+	// Maximum h_shift increment because tick sizes are unpredictable for some reason
+	const int h_shift_increment{ std::max(1, ticks_per_beat / settings.h_shift_increments_per_beat) }; // DO THIS ONCE AND DONT LOOP
+
+	// Flatten the (template, h_shift, v_shift) grid so candidates can be checked in any order. Results are
+	// collected by task index, so the output order is the same as the old nested loops regardless of thread count
+	std::vector<ShiftTask> tasks{};
+	for (int template_index{ 0 }; template_index < template_canons_array.size(); ++template_index) {
+#ifndef SINGLE_SHIFT_CHECK
+		for (int h_shift{ template_canons_array.at(template_index).get_max_h_shift() + h_shift_increment }; h_shift < leader_length_ticks * settings.h_shift_limit; h_shift += h_shift_increment) {
+			// settings.leader_length_ticks
+
+			for (int v_shift{ 0 }; v_shift >= -6; --v_shift) {
+				tasks.emplace_back(ShiftTask{ template_index, h_shift, v_shift });
 			}
 		}
 #endif // SINGLE_SHIFT_CHECK
+
+#ifdef SINGLE_SHIFT_CHECK
+		const int v_shift{ -1 };
+		const int h_shift{ 12 };
+		if (h_shift > leader_length_ticks) {
+			std::cout << "h_shift is too large\n";
+		}
+		tasks.emplace_back(ShiftTask{ template_index, h_shift, v_shift });
+#endif // SINGLE_SHIFT_CHECK
+	}
+
+	return tasks;
+}
+
+std::vector<Canon> generate_canons_for_new_voice(std::vector<Canon>& template_canons_array, const FollowerCache& followers, const int leader_length_ticks, const int ticks_per_measure, const int ticks_per_beat, const std::vector<int>& rhythmic_hierarchy_array, const int rhythmic_hierarchy_max_depth, const int rhythmic_hierarchy_of_beat, const Key& key, const CompactNote& measure_long_rest, const Settings& settings, PairCache& pair_cache) {
+	const std::vector<ShiftTask> tasks{ create_shift_tasks(template_canons_array, leader_length_ticks, ticks_per_beat, settings) };
+	std::vector<std::optional<Canon>> results(tasks.size());
+	parallel_for(tasks.size(), settings.threads, [&](const std::size_t task_index) {
+		const ShiftTask& task{ tasks.at(task_index) };
+		results.at(task_index) = check_candidate(template_canons_array.at(task.template_index), task.h_shift, task.v_shift, followers, leader_length_ticks, ticks_per_measure, rhythmic_hierarchy_array, rhythmic_hierarchy_max_depth, rhythmic_hierarchy_of_beat, key, measure_long_rest, settings, pair_cache);
+	});
+
+	std::vector<Canon> valid_canons_for_current_voice{};
+	for (std::optional<Canon>& result : results) {
+		if (result) {
+			valid_canons_for_current_voice.emplace_back(std::move(*result));
+		}
 	}
 
 	return valid_canons_for_current_voice;
 }
 
+void extend_canon_depth_first(const Canon& template_canon, const FollowerCache& followers, const int leader_length_ticks, const int ticks_per_measure, const int ticks_per_beat, const std::vector<int>& rhythmic_hierarchy_array, const int rhythmic_hierarchy_max_depth, const int rhythmic_hierarchy_of_beat, const Key& key, const CompactNote& measure_long_rest, const Settings& settings, PairCache& pair_cache, const std::function<void(const Canon&)>& on_valid_canon) {
+	// Same candidates as generate_canons_for_new_voice, but every valid canon is handed out and extended before
+	// the next shift is tried. Only one canon per voice count is alive at a time
+	if (template_canon.get_voice_count() >= settings.max_voices) {
+		return;
+	}
+
+	const int h_shift_increment{ std::max(1, ticks_per_beat / settings.h_shift_increments_per_beat) };
+	for (int h_shift{ template_canon.get_max_h_shift() + h_shift_increment }; h_shift < leader_length_ticks * settings.h_shift_limit; h_shift += h_shift_increment) {
+		// Check the shifts of one h_shift in parallel, then hand them out in the usual v_shift order
+		std::vector<std::optional<Canon>> results(7);
+		parallel_for(results.size(), settings.threads, [&](const std::size_t i) {
+			results.at(i) = check_candidate(template_canon, h_shift, -static_cast<int>(i), followers, leader_length_ticks, ticks_per_measure, rhythmic_hierarchy_array, rhythmic_hierarchy_max_depth, rhythmic_hierarchy_of_beat, key, measure_long_rest, settings, pair_cache);
+		});
+
+		for (std::optional<Canon>& result : results) {
+			if (!result) {
+				continue;
+			}
+			on_valid_canon(*result);
+			extend_canon_depth_first(*result, followers, leader_length_ticks, ticks_per_measure, ticks_per_beat, rhythmic_hierarchy_array, rhythmic_hierarchy_max_depth, rhythmic_hierarchy_of_beat, key, measure_long_rest, settings, pair_cache, on_valid_canon);
+			result.reset();
+		}
+	}
+}
+
 typedef std::function<void(Settings&, const std::string&)> OneArgHandle;
 
 const std::unordered_map<std::string, OneArgHandle> cmd_args{
@@ -555,226 +699,581 @@ const std::unordered_map<std::string, OneArgHandle> cmd_args{
 	  settings.measures_separation_between_output_canons = std::stoi(arg);
 	}},
 
+	{"-t", [](Settings& settings, const std::string& arg) {
+	  settings.threads = std::stoi(arg);
+	}},
+	{"--threads", [](Settings& settings, const std::string& arg) {
+	  settings.threads = std::stoi(arg);
+	}},
+
+	{"-d", [](Settings& settings, const std::string& arg) {
+	  settings.depth_first = ((arg == "true" || arg == "True") ? true : false);
+	}},
+	{"--depth-first", [](Settings& settings, const std::string& arg) {
+	  settings.depth_first = ((arg == "true" || arg == "True") ? true : false);
+	}},
+
+	{"-b", [](Settings& settings, const std::string& arg) {
+	  settings.batch_input = arg;
+	}},
+	{"--batch", [](Settings& settings, const std::string& arg) {
+	  settings.batch_input = arg;
+	}},
+	{"-e", [](Settings& settings, const std::string& arg) {
+	  settings.batch_extension = (arg.empty() || arg.front() == '.') ? arg : '.' + arg;
+	}},
+	{"--extension", [](Settings& settings, const std::string& arg) {
+	  settings.batch_extension = (arg.empty() || arg.front() == '.') ? arg : '.' + arg;
+	}},
+
+	{"-S", [](Settings& settings, const std::string& arg) {
+	  settings.serve = ((arg == "true" || arg == "True") ? true : false);
+	}},
+	{"--serve", [](Settings& settings, const std::string& arg) {
+	  settings.serve = ((arg == "true" || arg == "True") ? true : false);
+	}},
+
+	{"-f", [](Settings& settings, const std::string& arg) {
+	  settings.canons_per_file = std::stoi(arg);
+	}},
+	{"--canons-per-file", [](Settings& settings, const std::string& arg) {
+	  settings.canons_per_file = std::stoi(arg);
+	}},
+
 	{"-w", [](Settings& settings, const std::string& arg) {
 	  settings.warning_threshold = static_cast<int>(std::stoi(arg));
 	}},
 	{"--warning-threshold", [](Settings& settings, const std::string& arg) {
 	  settings.warning_threshold = static_cast<int>(std::stoi(arg));
 	}},
+
+	{"-j", [](Settings& settings, const std::string& arg) {
+	  settings.stats_file = arg;
+	}},
+	{"--stats", [](Settings& settings, const std::string& arg) {
+	  settings.stats_file = arg;
+	}},
 };
 
-int main(int argc, char* argv[]) {
-	try {
-		Settings settings{};
+struct CanonStatistics {
+	// Running sums for the summary label
+	int canon_count{};
+	int max_voice_count{ 2 };
+	double warnings_sum{};
+	double h_shift_sum{};
+	double invertibility_sum{};
+	double outer_voice_pairs_sum{};
+
+	void add(Canon& canon, const int voice_count) {
+		// voice_count doesn't include the empty voices added for output
+		++canon_count;
+		if (voice_count > max_voice_count) {
+			max_voice_count = voice_count;
+		}
+		warnings_sum += canon.get_warning_count();
+		h_shift_sum += canon.get_max_h_shift();
+		invertibility_sum += canon.get_non_invertible_voice_pairs_proportion();
+		outer_voice_pairs_sum += canon.get_invalid_outer_voice_pairs_proportion();
+	}
 
-		for (int i{ 1 }; i < argc; ++i) {
-			// Start at 1 because 0 is exe path
-			std::string option{ argv[i] };
+	const std::string get_text(const int leader_length_ticks) const {
+		std::string text{};
+		text += (std::to_string(canon_count) + " valid canons\n");
+		text += ("Max voice count: " + std::to_string(max_voice_count) + '\n');
+		text += ("Average warnings count: " + std::to_string(warnings_sum / canon_count) + '\n');
+		text += ("Average horizontal shift: " + std::to_string(h_shift_sum / canon_count / leader_length_ticks) + '\n');
+		text += ("Average invertibility: " + std::to_string(1 - (invertibility_sum / canon_count)) + '\n');
+		text += ("Average valid outer voice pairs proportion: " + std::to_string(1 - (outer_voice_pairs_sum / canon_count)) + '\n');
+		return text;
+	}
+};
 
-			if (option == "-h" || option == "--help") {
-				std::cout << help_message;
-				return 0;
-			}
+const SearchSetup create_search_setup(const SubjectData& subject, const bool minor_key) {
+	const CompactVoice& compact_leader{ subject.leader };
+
+	// Key signature
+	const int fifths{ subject.fifths };
+	const std::vector<int> key_signature{ alters_by_key(fifths) };
+
+	// Scale degrees
+	const ScaleDegree tonic{ get_tonic(fifths, minor_key) };
+	const int tonic_step{ static_cast<int>(tonic.step) };
+	const int dominant_step{ (tonic_step + 4) % 7 };
+	const ScaleDegree dominant{ static_cast<mx::api::Step>(dominant_step), key_signature.at(dominant_step) + 1 };
+	const int leading_tone_step{ (tonic_step + 6) % 7 };
+	const ScaleDegree leading_tone{ static_cast<mx::api::Step>(leading_tone_step), key_signature.at(leading_tone_step) + 1 };
+
+	// Calculate ticks per measure and initialize other variables
+	const int ticks_per_measure{ subject.ticks_per_measure }; // Use original score, before horizontal shifting
+	const int leader_length_measures{ subject.measure_count };
+	const mx::api::NoteData measure_long_rest{ create_rest(ticks_per_measure, ticks_per_measure, subject.time_signature) };
+
+	// Get leader length
+	int leader_start_index{ 0 };
+	for (int i{ 0 }; i < compact_leader.size(); ++i) {
+		if (compact_leader.at(i).is_rest()) {
+			leader_start_index += compact_leader.at(i).get_duration_ticks();
+		}
+		else {
+			break;
+		}
+	}
 
-			if (auto k{ cmd_args.find(option) }; k != cmd_args.end())
-				// Yes, do we have a parameter?
-				if (++i < argc) {
-					// Yes, handle it!
-					k->second(settings, { argv[i] });
-				}
-				else {
-					// No, and we cannot continue, throw an error
-					throw std::runtime_error{ "missing param after " + option };
+	int leader_end_index{ ticks_per_measure * leader_length_measures };
+	for (std::size_t i{ compact_leader.size() - 1 }; leader_end_index >= 0; --i) {
+		if (compact_leader.at(i).is_rest()) {
+			leader_end_index -= compact_leader.at(i).get_duration_ticks();
+		}
+		else {
+			break;
+		}
+	}
+
+	// Generate rhythmic hierarchy
+	const std::vector<int> rhythmic_hierarchy_array{ create_rhythmic_hierarchy_array(ticks_per_measure, subject.time_signature) };
+	const int ticks_per_beat{ ticks_per_measure / subject.time_signature.beats };
+
+	return SearchSetup{
+		key_signature,
+		Key{ tonic, dominant, leading_tone },
+		subject.time_signature,
+		ticks_per_measure,
+		ticks_per_beat,
+		leader_length_measures,
+		leader_end_index - leader_start_index,
+		measure_long_rest,
+		CompactNote{ measure_long_rest },
+		rhythmic_hierarchy_array,
+		*std::max_element(rhythmic_hierarchy_array.begin(), rhythmic_hierarchy_array.end()),
+		rhythmic_hierarchy_array.at(ticks_per_beat), // Second beat is always on the weakest beat hierarchies
+	};
+}
+
+const std::string generate_canons(const InputScore& input, const Settings& settings, PairCache& pair_cache, const std::function<void(const mx::api::ScoreData&)>& on_output_score) {
+	// Hands out an output score every settings.canons_per_file canons (or once at the end if 0) and returns the summary
+	// pair_cache may be warm from earlier runs, as long as they had the same subject, key and warning threshold
+	const SubjectData& subject{ input.get_subject() };
+	const CompactVoice& compact_leader{ subject.leader };
+	const bool minor_key{ settings.minor_key };
+
+	const SearchSetup setup{ create_search_setup(subject, minor_key) };
+	const std::vector<int>& key_signature{ setup.key_signature };
+	const Key& key{ setup.key };
+	const mx::api::TimeSignatureData& time_signature{ setup.time_signature };
+	const int ticks_per_measure{ setup.ticks_per_measure };
+	const int ticks_per_beat{ setup.ticks_per_beat };
+	const int leader_length_measures{ setup.leader_length_measures };
+	const int leader_length_ticks{ setup.leader_length_ticks };
+	const mx::api::NoteData& measure_long_rest{ setup.measure_long_rest };
+	const std::vector<int>& rhythmic_hierarchy_array{ setup.rhythmic_hierarchy_array };
+	const int rhythmic_hierarchy_max_depth{ setup.rhythmic_hierarchy_max_depth };
+	const int rhythmic_hierarchy_of_beat{ setup.rhythmic_hierarchy_of_beat };
+	const mx::api::BarlineData double_barline{ create_barline() };
+
+	// Output is templated on the full input score, which isn't parsed until the first canon is found
+	struct OutputTemplate {
+		const mx::api::ScoreData& score;
+		Voice leader;
+		mx::api::MeasureData empty_measure;
+	};
+	std::optional<OutputTemplate> output_template{};
+	const auto get_output_template{ [&]() -> const OutputTemplate& {
+		if (!output_template) {
+			const StageTimer timer{ Stage::read_input };
+			const mx::api::ScoreData& score{ input.get_score() };
+			output_template.emplace(OutputTemplate{ score, create_voice_array(score), create_measure(measure_long_rest, score.parts.at(0).measures.back()) });
+		}
+		return *output_template;
+	} };
+
+	// Output is built as canons are found, so the depth-first search never has to hold on to them. Every
+	// settings.canons_per_file canons it is handed out and started over, so memory doesn't grow with the canon count
+	CanonStatistics statistics{};
+	CanonStatistics file_statistics{};
+	std::vector<mx::api::PartData> valid_canons_parts_sequence(settings.max_voices);
+	const auto flush_output{ [&]() {
+		if (file_statistics.canon_count == 0) {
+			return;
+		}
+		const OutputTemplate& output{ get_output_template() };
+
+		// Remove extra time signatures and clefs
+		for (mx::api::PartData& part : valid_canons_parts_sequence) {
+			// Make an empty measure for summary label
+			part.measures.insert(part.measures.begin(), output.empty_measure);
+			part.measures.at(0).timeSignature = part.measures.at(1).timeSignature;
+			part.measures.at(0).keys = part.measures.at(1).keys;
+			part.measures.at(0).barlines.emplace_back(double_barline);
+
+			for (int i{ 1 }; i < part.measures.size(); ++i) {
+				// Start at second measure
+				mx::api::MeasureData& measure{ part.measures.at(i) };
+				//measure.barlines = std::vector<mx::api::BarlineData>{};
+				measure.timeSignature.isImplicit = true;
+				for (mx::api::StaffData& staff: measure.staves) {
+					staff.clefs = std::vector<mx::api::ClefData>{};
 				}
-			else
-				std::cerr << "unrecognized command-line option " << option << std::endl;
-		}
-
-		// Read file
-		const std::string& xml{ read_file(settings.input_file) };
-		const mx::api::ScoreData& score{ get_score_object(xml) };
-		const Voice leader{ create_voice_array(score) };
-
-		// Key signature
-		const int fifths{ (score.parts.at(0).measures.at(0).keys.size() > 0) ? score.parts.at(0).measures.at(0).keys.at(0).fifths : 0 };
-		const bool minor_key{ settings.minor_key };
-		const std::vector<int> key_signature{ alters_by_key(fifths) };
-
-		// Scale degrees
-		const ScaleDegree tonic{ get_tonic(fifths, settings.minor_key) };
-		const int tonic_step{ static_cast<int>(tonic.step) };
-		const int dominant_step{ (tonic_step + 4) % 7 };
-		const ScaleDegree dominant{ static_cast<mx::api::Step>(dominant_step), alters_by_key(fifths).at(dominant_step) + 1 };
-		const int leading_tone_step{ (tonic_step + 6) % 7 };
-		const ScaleDegree leading_tone{ static_cast<mx::api::Step>(leading_tone_step), alters_by_key(fifths).at(leading_tone_step) + 1 };
-		const Key key{ tonic, dominant, leading_tone };
-
-		// Get time signature
-		const mx::api::TimeSignatureData& time_signature{ score.parts.at(0).measures.at(0).timeSignature };
-
-		// Calculate ticks per measure and initialize other variables
-		const mx::api::NoteData& last_note{ score.parts.at(0).measures.at(0).staves.at(0).voices.at(0).notes.back() }; // Use original score, before horizontal shifting
-		const int ticks_per_measure{ last_note.tickTimePosition + last_note.durationData.durationTimeTicks };
-		const int leader_length_measures{ static_cast<int>(score.parts.at(0).measures.size()) };
-		//const int leader_length_ticks{ ticks_per_measure * leader_length_measures };
-		const mx::api::NoteData measure_long_rest{ create_rest(ticks_per_measure, ticks_per_measure, time_signature) };
-		const mx::api::MeasureData empty_measure{ create_measure(measure_long_rest, score.parts.at(0).measures.back()) };
-		const mx::api::BarlineData double_barline{ create_barline() };
-
-		// Get leader length
-		int leader_start_index{ 0 };
-		for (int i{ 0 }; i < leader.size(); ++i) {
-			if (leader.at(i).isRest) {
-				leader_start_index += leader.at(i).durationData.durationTimeTicks;
 			}
-			else {
-				break;
+		}
+
+		// Summary label
+		mx::api::WordsData words{};
+		words.text = file_statistics.get_text(leader_length_ticks);
+		std::vector<mx::api::DirectionData>& directions{ valid_canons_parts_sequence.at(0).measures.at(0).staves.at(0).directions };
+		directions.emplace_back(mx::api::DirectionData{});
+		directions.back().words.emplace_back(words);
+
+		on_output_score(create_output_score(output.score, valid_canons_parts_sequence)); // add follower(s) to original score
+
+		valid_canons_parts_sequence = std::vector<mx::api::PartData>(settings.max_voices);
+		file_statistics = CanonStatistics{};
+	} };
+
+	const auto add_canon_to_output{ [&](Canon canon) {
+		// Create musicxml
+		const StageTimer timer{ Stage::build_output };
+		const OutputTemplate& output{ get_output_template() };
+		const mx::api::PartData& leader_part{ output.score.parts.at(0) };
+
+		std::vector<mx::api::PartData> parts_array(settings.max_voices);
+		parts_array.at(0) = leader_part;
+		const int canon_voice_count{ canon.get_voice_count() };
+		for (int i{ 1 }; i < settings.max_voices; ++i) { // Skip first because first is leader part
+			if (i >= canon_voice_count) {
+				canon.add_voice(CanonVoice{}, Shift{}); // Still counts towards the voice pair proportions
+				const Voice empty_voice(2 * leader_length_measures, measure_long_rest); // Add one empty measure for now. Extend the part later
+				parts_array.at(i) = voice_array_to_part(output.score, empty_voice, ticks_per_measure, time_signature, measure_long_rest, leader_length_measures);
+				continue;
 			}
+			parts_array.at(i) = voice_array_to_part(output.score, realize_voice(canon, i, output.leader, key_signature, key, minor_key, ticks_per_measure, time_signature, measure_long_rest), ticks_per_measure, time_signature, measure_long_rest, leader_length_measures); // Need a function to fix barlines
 		}
 
-		int leader_end_index{ ticks_per_measure * leader_length_measures };
-		for (std::size_t i{ leader.size() - 1 }; leader_end_index >= 0; --i) {
-			if (leader.at(i).isRest) {
-				leader_end_index -= leader.at(i).durationData.durationTimeTicks;
+		// Extend every part to the same length
+		int longest_part_size{ 0 };
+		for (const mx::api::PartData& part : parts_array) { // Get longest part
+			if (part.measures.size() > longest_part_size) {
+				longest_part_size = part.measures.size();
 			}
-			else {
-				break;
+		}
+		for (mx::api::PartData& part : parts_array) {
+			part = extend_part_length(part, longest_part_size - part.measures.size(), time_signature, measure_long_rest);
+		}
+
+		// FIGURE OUT HOW TO GET WARNINGS COUNT FOR EACH
+		// Add text labels
+		parts_array.at(0).measures.at(0).staves.at(0).directions.emplace_back(create_canon_label(canon));
+
+		// Push parts in canon into final valid_canons_parts_sequence
+		for (int part{ 0 }; part < settings.max_voices; ++part) {
+			for (const mx::api::MeasureData& measure : parts_array.at(part).measures) {
+				// For each part, add each note to valid_canons_sequence
+				valid_canons_parts_sequence.at(part).measures.emplace_back(measure);
+			}
+			valid_canons_parts_sequence.at(part).measures.back().barlines.push_back(double_barline);
+			for (int i{ 0 }; i < settings.measures_separation_between_output_canons; ++i) {
+				valid_canons_parts_sequence.at(part).measures.emplace_back(output.empty_measure);
 			}
 		}
-		const int leader_length_ticks{ leader_end_index - leader_start_index };
 
-		// Generate rhythmic hierarchy
-		const std::vector<int> rhythmic_hierarchy_array{ create_rhythmic_hierarchy_array(ticks_per_measure, time_signature) };
-		const int rhythmic_hierarchy_max_depth{ *std::max_element(rhythmic_hierarchy_array.begin(), rhythmic_hierarchy_array.end()) };
-		const int ticks_per_beat{ ticks_per_measure / time_signature.beats };
-		const int rhythmic_hierarchy_of_beat{ rhythmic_hierarchy_array.at(ticks_per_beat) }; // Second beat is always on the weakest beat hierarchies
+		statistics.add(canon, canon_voice_count);
+		file_statistics.add(canon, canon_voice_count);
+		if (settings.canons_per_file > 0 && file_statistics.canon_count >= settings.canons_per_file) {
+			flush_output();
+		}
+	} };
 
-		// Until template_canons_array is empty or when max_voices is reached
-		int valid_canons_counter{ 0 };
-		std::vector<Canon> valid_canons{};
-		std::vector<Canon> template_canons_array{ Canon{std::vector<Voice>{leader}, 0, 0 } };
+	// Until template_canons_array is empty or when max_voices is reached
+	const CompactNote& compact_measure_long_rest{ setup.compact_measure_long_rest };
+	const FollowerCache followers{ compact_leader, leader_length_ticks, ticks_per_beat, key_signature, key, minor_key, ticks_per_measure, settings };
+	const Canon leader_canon{ std::vector<CanonVoice>{ CanonVoice{ followers.get_follower(0, 0), compact_measure_long_rest } }, std::vector<Shift>{ Shift{ 0, 0 } }, 0, 0 };
 
+	if (settings.depth_first) {
+		extend_canon_depth_first(leader_canon, followers, leader_length_ticks, ticks_per_measure, ticks_per_beat, rhythmic_hierarchy_array, rhythmic_hierarchy_max_depth, rhythmic_hierarchy_of_beat, key, compact_measure_long_rest, settings, pair_cache, add_canon_to_output);
+	}
+	else {
+		std::vector<Canon> template_canons_array{ leader_canon };
 		for (int i{ 0 }; i < settings.max_voices - 1; ++i) {
-			const std::vector<Canon> valid_canons_for_current_voice{ generate_canons_for_new_voice(template_canons_array, leader, leader_length_ticks, ticks_per_measure, ticks_per_beat, rhythmic_hierarchy_array, rhythmic_hierarchy_max_depth, rhythmic_hierarchy_of_beat, key_signature, key, minor_key, time_signature, measure_long_rest, settings) };
-			template_canons_array = valid_canons_for_current_voice;
-
-			valid_canons.reserve(valid_canons.size() + valid_canons_for_current_voice.size());
-			for (const Canon& canon : valid_canons_for_current_voice) {
-				valid_canons.emplace_back(canon);
+			template_canons_array = generate_canons_for_new_voice(template_canons_array, followers, leader_length_ticks, ticks_per_measure, ticks_per_beat, rhythmic_hierarchy_array, rhythmic_hierarchy_max_depth, rhythmic_hierarchy_of_beat, key, compact_measure_long_rest, settings, pair_cache);
+			for (const Canon& canon : template_canons_array) {
+				add_canon_to_output(canon);
 			}
 		}
-		valid_canons_counter = valid_canons.size();
+	}
+
+	flush_output();
+
+	if (statistics.canon_count == 0) {
+		return "No valid canons found!\n";
+	}
+
+	return statistics.get_text(leader_length_ticks);
+}
 
-		if (valid_canons_counter == 0) {
-			std::cout << "No valid canons found!\n";
-			return 0;
+const std::string numbered_path(const std::string& path, const int number) {
+	// "canons.musicxml", 3 -> "canons_3.musicxml"
+	std::filesystem::path numbered{ path };
+	numbered.replace_filename(numbered.stem().string() + '_' + std::to_string(number) + numbered.extension().string());
+	return numbered.string();
+}
+
+const std::string generate_canon_file(const Settings& settings) {
+	// Reads settings.input_file, writes the valid canons to settings.output_file (numbered files if
+	// settings.canons_per_file is set) and returns the summary
+	PairCache pair_cache{}; // Shared by every candidate of this run
+	int file_number{ 0 };
+	const InputScore input{ [&]() {
+		const StageTimer timer{ Stage::read_input };
+		return read_input_file(settings.input_file);
+	}() };
+	return generate_canons(input, settings, pair_cache, [&](const mx::api::ScoreData& output_score) {
+		const StageTimer timer{ Stage::write_output };
+		if (settings.canons_per_file > 0) {
+			write_file(output_score, numbered_path(settings.output_file, ++file_number));
+		}
+		else {
+			write_file(output_score, settings.output_file);
 		}
+	});
+}
 
-		int max_voice_count{ 2 };
-		for (const Canon& canon : valid_canons) {
-			if (canon.get_voice_count() > max_voice_count) {
-				max_voice_count = canon.get_voice_count();
+const std::vector<std::string> get_batch_inputs(const std::string& path) {
+	// A directory of MusicXML files, or a text file with one path per line
+	std::vector<std::string> inputs{};
+	if (std::filesystem::is_directory(path)) {
+		for (const std::filesystem::directory_entry& entry : std::filesystem::directory_iterator{ path }) {
+			const std::string extension{ entry.path().extension().string() };
+			if (entry.is_regular_file() && (extension == ".musicxml" || extension == ".xml")) {
+				inputs.emplace_back(entry.path().string());
 			}
 		}
+		std::sort(inputs.begin(), inputs.end()); // directory_iterator order is unspecified
+		return inputs;
+	}
 
-		// Get various scores
+	std::istringstream manifest{ read_file(path) };
+	for (std::string line{}; std::getline(manifest, line);) {
+		if (!line.empty() && line.back() == '\r') {
+			line.pop_back();
+		}
+		if (!line.empty()) {
+			inputs.emplace_back(line);
+		}
+	}
+	return inputs;
+}
 
-		// Generate output musicxml
-		std::vector<mx::api::PartData> valid_canons_parts_sequence(settings.max_voices);
-		for (Canon& canon : valid_canons) {
-			// Create musicxml
-			const mx::api::PartData& leader_part{ score.parts.at(0) };
+const std::vector<std::string> get_batch_outputs(const Settings& settings, const std::vector<std::string>& inputs) {
+	// One output per subject, named after it, in the settings.output_file directory. Throws before anything is
+	// written if two subjects would share an output or an output would overwrite an input
+	const std::filesystem::path output_directory{ settings.output_file };
+	if (std::filesystem::is_directory(settings.batch_input) && std::filesystem::exists(output_directory) && std::filesystem::equivalent(settings.batch_input, output_directory)) {
+		throw Exception{ "The batch output directory can't be the input directory!\n" };
+	}
 
-			std::vector<mx::api::PartData> parts_array(settings.max_voices);
-			parts_array.at(0) = leader_part;
-			for (int i{ 1 }; i < settings.max_voices; ++i) { // Skip first because first is leader part
-				if (i >= canon.texture().size()) {
-					canon.add_voice(Voice{});
-					for (int j{ 0 }; j < 2 * leader_length_measures; ++j) {
-						canon.texture().back().emplace_back(measure_long_rest); // Add one empty measure for now. Extend the part later
-					}
-				}
-				parts_array.at(i) = voice_array_to_part(score, canon.texture().at(i), ticks_per_measure, time_signature, measure_long_rest, leader_length_measures); // Need a function to fix barlines
-			}
+	std::unordered_map<std::string, std::string> input_of_path{};
+	for (const std::string& input : inputs) {
+		input_of_path.emplace(std::filesystem::weakly_canonical(input).string(), input);
+	}
 
-			// Extend every part to the same length
-			int longest_part_size{ 0 };
-			for (const mx::api::PartData& part : parts_array) { // Get longest part
-				if (part.measures.size() > longest_part_size) {
-					longest_part_size = part.measures.size();
-				}
+	std::unordered_map<std::string, std::string> subject_of_output{};
+	std::vector<std::string> outputs{};
+	for (const std::string& input : inputs) {
+		const std::filesystem::path output{ (output_directory / std::filesystem::path{ input }.filename()).replace_extension(settings.batch_extension) };
+		const std::string path{ std::filesystem::weakly_canonical(output).string() };
+		if (const auto overwritten{ input_of_path.find(path) }; overwritten != input_of_path.end()) {
+			throw Exception{ "The output for " + input + " would overwrite the input " + overwritten->second + "!\n" };
+		}
+		if (const auto [other, is_new] { subject_of_output.emplace(path, input) }; !is_new) {
+			throw Exception{ input + " and " + other->second + " would both be written to " + output.string() + "!\n" };
+		}
+		outputs.emplace_back(output.string());
+	}
+	return outputs;
+}
+
+void run_batch(const Settings& settings) {
+	// Subjects are spread over the worker threads, each subject searched on one thread
+	const std::vector<std::string> inputs{ get_batch_inputs(settings.batch_input) };
+	const std::vector<std::string> outputs{ get_batch_outputs(settings, inputs) };
+	std::filesystem::create_directories(settings.output_file);
+
+	std::mutex print_mutex{};
+	parallel_for(inputs.size(), settings.threads, [&](const std::size_t i) {
+		Settings subject_settings{ settings };
+		subject_settings.input_file = inputs.at(i);
+		subject_settings.output_file = outputs.at(i);
+		subject_settings.threads = 1;
+
+		std::string summary{};
+		try {
+			summary = generate_canon_file(subject_settings);
+		}
+		catch (const Exception& exception) {
+			summary = exception.getError(); // One bad subject shouldn't stop the batch
+		}
+		catch (const std::exception& exception) {
+			summary = std::string{ exception.what() } + '\n';
+		}
+
+		const std::lock_guard<std::mutex> lock{ print_mutex };
+		std::cout << inputs.at(i) << ":\n" << summary;
+	});
+}
+
+void parse_options(Settings& settings, const std::vector<std::string>& options) {
+	for (std::size_t i{ 0 }; i < options.size(); ++i) {
+		const std::string& option{ options.at(i) };
+		if (auto k{ cmd_args.find(option) }; k != cmd_args.end())
+			// Yes, do we have a parameter?
+			if (++i < options.size()) {
+				// Yes, handle it!
+				k->second(settings, options.at(i));
 			}
-			for (mx::api::PartData& part : parts_array) {
-				part = extend_part_length(part, longest_part_size - part.measures.size(), time_signature, measure_long_rest);
+			else {
+				// No, and we cannot continue, throw an error
+				throw std::runtime_error{ "missing param after " + option };
 			}
+		else
+			std::cerr << "unrecognized command-line option " << option << std::endl;
+	}
+}
 
-			// FIGURE OUT HOW TO GET WARNINGS COUNT FOR EACH
-			// Add text labels
-			parts_array.at(0).measures.at(0).staves.at(0).directions.emplace_back(create_canon_label(canon));
+struct WarmSubject {
+	std::optional<InputScore> input{};
+	PairCache pair_cache{};
+};
 
-			// Push parts in canon into final valid_canons_parts_sequence
-			for (int part{ 0 }; part < settings.max_voices; ++part) {
-				for (const mx::api::MeasureData& measure : parts_array.at(part).measures) {
-					// For each part, add each note to valid_canons_sequence
-					valid_canons_parts_sequence.at(part).measures.emplace_back(measure);
-				}
-				valid_canons_parts_sequence.at(part).measures.back().barlines.push_back(double_barline);
-				for (int i{ 0 }; i < settings.measures_separation_between_output_canons; ++i) {
-					valid_canons_parts_sequence.at(part).measures.emplace_back(empty_measure);
-				}
-			}
+void serve(const Settings& settings) {
+	// Answers requests on stdin/stdout, so the generator can run as a backend. A request is a header line
+	//   <byte count> [options]
+	// followed by that many bytes of MusicXML. The options are the usual command line options and only apply
+	// to that request. The reply is
+	//   ok <summary byte count> <MusicXML byte count>
+	// followed by the summary and the output score (0 bytes if there are no valid canons), or
+	//   error <byte count>
+	// followed by the message. An empty line or "quit" ends the session, and so do a request over
+	// max_request_bytes and one whose MusicXML is cut short (after their error reply).
+	// Parsed subjects and their pair caches are kept between requests, keyed by everything the checker's
+	// verdicts depend on
+	constexpr std::size_t max_warm_subjects{ 64 };
+	constexpr std::size_t max_request_bytes{ 256 * 1024 * 1024 };
+	std::unordered_map<std::string, WarmSubject> warm_subjects{};
+
+	for (std::string header{}; std::getline(std::cin, header);) {
+		if (!header.empty() && header.back() == '\r') {
+			header.pop_back();
+		}
+		if (header.empty() || header == "quit") {
+			break;
 		}
 
-		// Remove extra time signatures and clefs
-		for (mx::api::PartData& part : valid_canons_parts_sequence) {
-			// Make an empty measure for summary label
-			part.measures.insert(part.measures.begin(), empty_measure);
-			part.measures.at(0).timeSignature = part.measures.at(1).timeSignature;
-			part.measures.at(0).keys = part.measures.at(1).keys;
-			part.measures.at(0).barlines.emplace_back(double_barline);
+		const auto reply_error{ [](const std::string& message) {
+			std::cout << "error " << message.size() << '\n' << message << std::flush;
+		} };
 
-			for (int i{ 1 }; i < part.measures.size(); ++i) {
-				// Start at second measure
-				mx::api::MeasureData& measure{ part.measures.at(i) };
-				//measure.barlines = std::vector<mx::api::BarlineData>{};
-				measure.timeSignature.isImplicit = true;
-				for (mx::api::StaffData& staff: measure.staves) {
-					staff.clefs = std::vector<mx::api::ClefData>{};
+		std::istringstream header_stream{ header };
+		std::size_t xml_bytes{};
+		if (!(header_stream >> xml_bytes)) {
+			reply_error("Bad request header \"" + header + "\"!\n");
+			continue;
+		}
+		std::vector<std::string> options{};
+		for (std::string option{}; header_stream >> option;) {
+			options.emplace_back(option);
+		}
+
+		if (xml_bytes > max_request_bytes) {
+			// The body can't be skipped reliably, so there's no next request to find
+			reply_error("Request of " + std::to_string(xml_bytes) + " bytes is over the limit of " + std::to_string(max_request_bytes) + " bytes!\n");
+			break;
+		}
+
+		bool is_truncated{ false };
+		try {
+			std::string xml(xml_bytes, '\0');
+			if (!std::cin.read(xml.data(), static_cast<std::streamsize>(xml_bytes))) {
+				is_truncated = true;
+				throw Exception{ "Request ended after " + std::to_string(std::cin.gcount()) + " of " + std::to_string(xml_bytes) + " bytes!\n" };
+			}
+
+			Settings request_settings{ settings };
+			request_settings.serve = false;
+			parse_options(request_settings, options);
+
+			const std::string subject_key{ std::to_string(request_settings.minor_key) + ' ' + std::to_string(request_settings.warning_threshold) + '\n' + xml };
+			if (warm_subjects.size() >= max_warm_subjects && warm_subjects.find(subject_key) == warm_subjects.end()) {
+				warm_subjects.clear();
+			}
+			const auto [subject, is_new_subject] { warm_subjects.try_emplace(subject_key) };
+			if (is_new_subject) {
+				try {
+					const StageTimer timer{ Stage::read_input };
+					subject->second.input.emplace(read_input_string(xml));
+				}
+				catch (...) {
+					warm_subjects.erase(subject);
+					throw;
 				}
 			}
-		}
 
-		// Summary label
-		double warnings_sum{};
-		double h_shift_sum{};
-		double invertibility_sum{};
-		double outer_voice_pairs_sum{};
-		for (Canon& canon : valid_canons) {
-			warnings_sum += canon.get_warning_count();
-			h_shift_sum += canon.get_max_h_shift();
-			invertibility_sum += canon.get_non_invertible_voice_pairs_proportion();
-			outer_voice_pairs_sum += canon.get_invalid_outer_voice_pairs_proportion();
+			request_settings.canons_per_file = 0; // One reply, one score
+			std::string output_xml{};
+			const std::string summary{ generate_canons(*subject->second.input, request_settings, subject->second.pair_cache, [&](const mx::api::ScoreData& output_score) {
+				const StageTimer timer{ Stage::write_output };
+				output_xml = write_string(output_score);
+			}) };
+			std::cout << "ok " << summary.size() << ' ' << output_xml.size() << '\n' << summary << output_xml << std::flush;
+		}
+		catch (const Exception& exception) {
+			reply_error(std::string{ exception.getError() });
+		}
+		catch (const std::exception& exception) {
+			reply_error(std::string{ exception.what() } + '\n');
+		}
+		if (is_truncated) {
+			break;
 		}
+	}
+}
 
-		mx::api::WordsData words{};
-		words.text += (std::to_string(valid_canons_counter) + " valid canons\n");
-		words.text += ("Max voice count: " + std::to_string(max_voice_count) + '\n');
-		words.text += ("Average warnings count: " + std::to_string(warnings_sum / valid_canons_counter) + '\n');
-		words.text += ("Average horizontal shift: " + std::to_string(h_shift_sum / valid_canons_counter / leader_length_ticks) + '\n');
-		words.text += ("Average invertibility: " + std::to_string(1 - (invertibility_sum / valid_canons_counter)) + '\n');
-		words.text += ("Average valid outer voice pairs proportion: " + std::to_string(1 - (outer_voice_pairs_sum / valid_canons_counter)) + '\n');
+#ifndef CANON_GENERATOR_NO_MAIN
+int main(int argc, char* argv[]) {
+	try {
+		Settings settings{};
 
-		//
-		std::cout << words.text;
+		std::vector<std::string> options{};
+		for (int i{ 1 }; i < argc; ++i) {
+			// Start at 1 because 0 is exe path
+			options.emplace_back(argv[i]);
+			if (options.back() == "-h" || options.back() == "--help") {
+				std::cout << help_message;
+				return 0;
+			}
+		}
+		parse_options(settings, options);
 
-		std::vector<mx::api::DirectionData>& directions{ valid_canons_parts_sequence.at(0).measures.at(0).staves.at(0).directions };
-		directions.emplace_back(mx::api::DirectionData{});
-		directions.back().words.emplace_back(words);
+		if (!settings.stats_file.empty()) {
+			enable_stage_timers();
+			start_stats_clock();
+		}
 
-		const mx::api::ScoreData output_score{ create_output_score(score, valid_canons_parts_sequence) }; // add follower(s) to original score
+		if (settings.serve) {
+			serve(settings);
+		}
+		else if (!settings.batch_input.empty()) {
+			run_batch(settings);
+		}
+		else {
+			std::cout << generate_canon_file(settings);
+		}
 
-		//// Write file
-		write_file(output_score, settings.output_file); // output_score
+		if (!settings.stats_file.empty()) {
+			std::ofstream stats_file{ settings.stats_file };
+			if (!stats_file) {
+				throw Exception{ "Could not write stats to " + settings.stats_file + "!\n" };
+			}
+			stats_file << get_stats_json();
+		}
 	}
 	catch (const Exception& exception) {
 		std::cout << exception.getError();
@@ -782,6 +1281,7 @@ int main(int argc, char* argv[]) {
 
 	return 0;
 }
+#endif // CANON_GENERATOR_NO_MAIN
 
 
 //#include "mx/api/DocumentManager.h"
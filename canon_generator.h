@@ -0,0 +1,73 @@
+#pragma once
+
+#include "settings.h"
+#include "canon.h"
+#include "compact_note.h"
+#include "counterpoint_checker.h"
+#include "pair_cache.h"
+#include "file_reader.h"
+
+#include "mx/api/ScoreData.h"
+
+#include <memory>
+#include <optional>
+#include <vector>
+
+// The generator's building blocks, for canon_bench. canon_generator.cpp is compiled into the bench with
+// CANON_GENERATOR_NO_MAIN defined, so it doesn't bring its own main()
+
+using Voice = std::vector<mx::api::NoteData>; // Condensed voice in terminology from create_voice_array()
+
+const std::vector<int> alters_by_key(const int fifths);
+const ScaleDegree get_tonic(const int fifths, const bool minor_key);
+const mx::api::NoteData create_rest(const int ticks, const int ticks_per_measure, const mx::api::TimeSignatureData& time_signature);
+const std::vector<int> create_rhythmic_hierarchy_array(const int ticks_per_measure, const mx::api::TimeSignatureData& time_signature);
+
+const CompactVoice shift(const CompactVoice& voice, const int v_shift, const int h_shift, const std::vector<int>& key_signature, const Key& key, const bool minor_key, const int ticks_per_measure);
+const Voice realize_voice(const Canon& canon, const int voice_index, const Voice& leader, const std::vector<int>& key_signature, const Key& key, const bool minor_key, const int ticks_per_measure, const mx::api::TimeSignatureData& time_signature, const mx::api::NoteData& measure_long_rest);
+const mx::api::PartData voice_array_to_part(const mx::api::ScoreData& score, Voice voice, const int ticks_per_measure, const mx::api::TimeSignatureData& time_signature, const mx::api::NoteData& measure_long_rest, const int leader_length_measures);
+const mx::api::ScoreData create_output_score(mx::api::ScoreData score, const std::vector<mx::api::PartData>& parts);
+
+// Everything the search derives from the subject before it starts
+struct SearchSetup {
+	std::vector<int> key_signature{};
+	Key key{};
+	mx::api::TimeSignatureData time_signature{};
+	int ticks_per_measure{};
+	int ticks_per_beat{};
+	int leader_length_measures{};
+	int leader_length_ticks{}; // Without the leader's starting and trailing rests
+	mx::api::NoteData measure_long_rest{};
+	CompactNote compact_measure_long_rest{};
+	std::vector<int> rhythmic_hierarchy_array{};
+	int rhythmic_hierarchy_max_depth{};
+	int rhythmic_hierarchy_of_beat{};
+};
+
+const SearchSetup create_search_setup(const SubjectData& subject, const bool minor_key);
+
+// Every follower the search can try, shifted once per run instead of once per template canon. Read-only after
+// construction, so every thread shares one
+class FollowerCache {
+public:
+	FollowerCache(const CompactVoice& leader, const int leader_length_ticks, const int ticks_per_beat, const std::vector<int>& key_signature, const Key& key, const bool minor_key, const int ticks_per_measure, const Settings& settings);
+
+	const std::shared_ptr<const CompactVoice>& get_follower(const int h_shift, const int v_shift) const; // h_shift 0, v_shift 0 is the leader
+
+private:
+	int m_h_shift_increment{};
+	std::vector<std::shared_ptr<const CompactVoice>> m_followers{}; // 7 v_shifts (0 to -6) per h_shift, from h_shift 0
+};
+
+std::vector<Canon> generate_canons_for_new_voice(std::vector<Canon>& template_canons_array, const FollowerCache& followers, const int leader_length_ticks, const int ticks_per_measure, const int ticks_per_beat, const std::vector<int>& rhythmic_hierarchy_array, const int rhythmic_hierarchy_max_depth, const int rhythmic_hierarchy_of_beat, const Key& key, const CompactNote& measure_long_rest, const Settings& settings, PairCache& pair_cache);
+
+struct ShiftTask {
+	int template_index{};
+	int h_shift{};
+	int v_shift{};
+};
+
+// Every follower generate_canons_for_new_voice tries to add to the template canons, in output order
+const std::vector<ShiftTask> create_shift_tasks(const std::vector<Canon>& template_canons_array, const int leader_length_ticks, const int ticks_per_beat, const Settings& settings);
+// template_canon with one follower added and the other voices padded to its length, before the checker has seen it
+Canon create_candidate(const Canon& template_canon, const int h_shift, const int v_shift, const FollowerCache& followers, const int leader_length_ticks, const int ticks_per_measure, const CompactNote& measure_long_rest);
@@ -0,0 +1,204 @@
+#include "checker_stats.h"
+
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <sstream>
+#include <unordered_set>
+
+constexpr std::size_t rule_count{ static_cast<std::size_t>(Rule::count) };
+constexpr std::size_t stat_counter_count{ static_cast<std::size_t>(StatCounter::count) };
+constexpr std::size_t stage_count{ static_cast<std::size_t>(Stage::count) };
+
+constexpr std::array<const char*, rule_count> rule_names{
+	"similar_motion_second_to_third",
+	"parallel_intervals",
+	"parallel_fifths",
+	"parallel_octaves",
+	"parallel_fifths_to_downbeat",
+	"parallel_octaves_to_downbeat",
+	"parallel_fifths_between_upbeats",
+	"parallel_octaves_between_upbeats",
+	"consecutive_perfect_consonances",
+	"doubled_leading_tone",
+	"doubled_retardation_resolution",
+	"seven_eight_suspension",
+	"suspension_to_perfect_consonance",
+	"seven_eight_appoggiatura",
+	"doubled_appoggiatura_resolution",
+	"appoggiatura_leap_same_direction",
+	"simultaneous_dissonance",
+	"illegal_dissonance",
+	"direct_perfect_interval_outer_inner",
+	"leap_to_perfect_interval",
+	"direct_perfect_interval_outer_voices",
+};
+
+constexpr std::array<const char*, stat_counter_count> stat_counter_names{
+	"candidates",
+	"valid_canons",
+	"fail_fast_rejections",
+	"voice_pair_checks",
+	"pair_cache_hits",
+	"voice_role_checks",
+	"role_cache_hits",
+};
+
+constexpr std::array<const char*, stage_count> stage_names{
+	"read_input",
+	"build_candidate",
+	"check_counterpoint",
+	"check_voice_pair",
+	"check_voice_roles",
+	"build_output",
+	"write_output",
+};
+
+struct StatsBlock {
+	// Only the owning thread writes, so a relaxed load and store is enough and never locks the bus. Atomic
+	// so get_stats_json() can read the blocks of running threads
+	std::array<std::atomic<std::uint64_t>, rule_count> rule_hits{};
+	std::array<std::atomic<std::uint64_t>, stat_counter_count> counters{};
+	std::array<std::atomic<std::uint64_t>, stage_count> stage_nanoseconds{};
+};
+
+void add_to_own_counter(std::atomic<std::uint64_t>& value, const std::uint64_t amount) {
+	value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+template <std::size_t size>
+void add_block_values(std::array<std::atomic<std::uint64_t>, size>& totals, const std::array<std::atomic<std::uint64_t>, size>& values) {
+	for (std::size_t i{ 0 }; i < size; ++i) {
+		totals.at(i).fetch_add(values.at(i).load(std::memory_order_relaxed), std::memory_order_relaxed);
+	}
+}
+
+struct StatsRegistry {
+	std::mutex mutex{};
+	std::unordered_set<const StatsBlock*> live_blocks{};
+	StatsBlock retired_totals{}; // Blocks of threads that have ended
+	std::atomic<bool> are_stage_timers_enabled{ false };
+	std::chrono::steady_clock::time_point start{ std::chrono::steady_clock::now() };
+};
+
+StatsRegistry& get_registry() {
+	// Never destroyed: the thread pool's workers can outlive every other static, and their thread_local blocks
+	// unregister here when they exit
+	static StatsRegistry* const registry{ new StatsRegistry{} };
+	return *registry;
+}
+
+class ThreadStats {
+public:
+	ThreadStats() {
+		StatsRegistry& registry{ get_registry() };
+		const std::lock_guard<std::mutex> lock{ registry.mutex };
+		registry.live_blocks.insert(&m_block);
+	}
+
+	~ThreadStats() {
+		StatsRegistry& registry{ get_registry() };
+		const std::lock_guard<std::mutex> lock{ registry.mutex };
+		add_block_values(registry.retired_totals.rule_hits, m_block.rule_hits);
+		add_block_values(registry.retired_totals.counters, m_block.counters);
+		add_block_values(registry.retired_totals.stage_nanoseconds, m_block.stage_nanoseconds);
+		registry.live_blocks.erase(&m_block);
+	}
+
+	StatsBlock& block() { return m_block; }
+
+private:
+	StatsBlock m_block{};
+};
+
+StatsBlock& get_thread_block() {
+	thread_local ThreadStats thread_stats{};
+	return thread_stats.block();
+}
+
+template <std::size_t size>
+void write_json_object(std::ostringstream& json, const std::array<const char*, size>& names, const std::array<std::uint64_t, size>& values, const double scale) {
+	json << '{';
+	for (std::size_t i{ 0 }; i < size; ++i) {
+		json << (i == 0 ? "" : ", ") << '"' << names.at(i) << "\": ";
+		if (scale == 1.0) {
+			json << values.at(i);
+		}
+		else {
+			json << static_cast<double>(values.at(i)) * scale;
+		}
+	}
+	json << '}';
+}
+
+void count_rule_hit(const Rule rule) {
+	add_to_own_counter(get_thread_block().rule_hits.at(static_cast<std::size_t>(rule)), 1);
+}
+
+void count_stat(const StatCounter counter) {
+	add_to_own_counter(get_thread_block().counters.at(static_cast<std::size_t>(counter)), 1);
+}
+
+void enable_stage_timers() {
+	get_registry().are_stage_timers_enabled.store(true, std::memory_order_relaxed);
+}
+
+void start_stats_clock() {
+	StatsRegistry& registry{ get_registry() };
+	const std::lock_guard<std::mutex> lock{ registry.mutex };
+	registry.start = std::chrono::steady_clock::now();
+}
+
+const std::string get_stats_json() {
+	StatsRegistry& registry{ get_registry() };
+	const std::lock_guard<std::mutex> lock{ registry.mutex };
+
+	std::array<std::uint64_t, rule_count> rule_hits{};
+	std::array<std::uint64_t, stat_counter_count> counters{};
+	std::array<std::uint64_t, stage_count> stage_nanoseconds{};
+	const auto sum_block{ [&](const StatsBlock& block) {
+		for (std::size_t i{ 0 }; i < rule_count; ++i) {
+			rule_hits.at(i) += block.rule_hits.at(i).load(std::memory_order_relaxed);
+		}
+		for (std::size_t i{ 0 }; i < stat_counter_count; ++i) {
+			counters.at(i) += block.counters.at(i).load(std::memory_order_relaxed);
+		}
+		for (std::size_t i{ 0 }; i < stage_count; ++i) {
+			stage_nanoseconds.at(i) += block.stage_nanoseconds.at(i).load(std::memory_order_relaxed);
+		}
+	} };
+	sum_block(registry.retired_totals);
+	for (const StatsBlock* block : registry.live_blocks) {
+		sum_block(*block);
+	}
+
+	const double wall_seconds{ std::chrono::duration<double>(std::chrono::steady_clock::now() - registry.start).count() };
+	const std::uint64_t candidates{ counters.at(static_cast<std::size_t>(StatCounter::candidates)) };
+
+	std::ostringstream json{};
+	json << "{\n";
+	json << "  \"wall_seconds\": " << wall_seconds << ",\n";
+	json << "  \"candidates_per_second\": " << ((wall_seconds > 0) ? candidates / wall_seconds : 0.0) << ",\n";
+	json << "  \"counters\": ";
+	write_json_object(json, stat_counter_names, counters, 1.0);
+	json << ",\n  \"rule_hits\": ";
+	write_json_object(json, rule_names, rule_hits, 1.0);
+	json << ",\n  \"stage_seconds\": ";
+	write_json_object(json, stage_names, stage_nanoseconds, 1e-9);
+	json << "\n}\n";
+	return json.str();
+}
+
+StageTimer::StageTimer(const Stage stage)
+	: m_stage{ stage }, m_is_enabled{ get_registry().are_stage_timers_enabled.load(std::memory_order_relaxed) } {
+	if (m_is_enabled) {
+		m_start = std::chrono::steady_clock::now();
+	}
+}
+
+StageTimer::~StageTimer() {
+	if (m_is_enabled) {
+		const std::chrono::nanoseconds elapsed{ std::chrono::steady_clock::now() - m_start };
+		add_to_own_counter(get_thread_block().stage_nanoseconds.at(static_cast<std::size_t>(m_stage)), static_cast<std::uint64_t>(elapsed.count()));
+	}
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Run statistics for --stats. Every thread counts into its own block, which is folded into the totals when the
+// thread ends, so counting never contends between threads. Counting doesn't change what the checker does: rule
+// hits are counted where messages are sent, so the checker still returns on its first error.
+// Rule hits only count checks that actually ran. Verdicts replayed from the PairCache aren't counted again.
+
+enum class Rule {
+	similar_motion_second_to_third,
+	parallel_intervals,
+	parallel_fifths,
+	parallel_octaves,
+	parallel_fifths_to_downbeat,
+	parallel_octaves_to_downbeat,
+	parallel_fifths_between_upbeats,
+	parallel_octaves_between_upbeats,
+	consecutive_perfect_consonances,
+	doubled_leading_tone,
+	doubled_retardation_resolution,
+	seven_eight_suspension,
+	suspension_to_perfect_consonance,
+	seven_eight_appoggiatura,
+	doubled_appoggiatura_resolution,
+	appoggiatura_leap_same_direction,
+	simultaneous_dissonance,
+	illegal_dissonance,
+	direct_perfect_interval_outer_inner,
+	leap_to_perfect_interval,
+	direct_perfect_interval_outer_voices,
+	count
+};
+
+enum class StatCounter {
+	candidates, // Calls to check_candidate
+	valid_canons,
+	fail_fast_rejections, // Canons rejected on a cached failing pair before any pair was checked
+	voice_pair_checks, // Calls to check_voice_pair
+	pair_cache_hits, // Voice pairs answered by the PairCache in check_counterpoint
+	voice_role_checks, // Calls to check_voice_roles, only made for canons whose pairs are all valid
+	role_cache_hits,
+	count
+};
+
+enum class Stage {
+	// Times are inclusive and summed over threads: check_voice_pair and check_voice_roles are also part of check_counterpoint
+	read_input,
+	build_candidate,
+	check_counterpoint,
+	check_voice_pair,
+	check_voice_roles,
+	build_output,
+	write_output,
+	count
+};
+
+void count_rule_hit(const Rule rule);
+void count_stat(const StatCounter counter);
+
+void enable_stage_timers(); // Timers cost two clock reads each, so they only run with --stats
+void start_stats_clock(); // Wall time for candidates per second
+const std::string get_stats_json(); // Totals of every thread so far, including the ones still running
+
+class StageTimer {
+public:
+	StageTimer(const Stage stage);
+	~StageTimer();
+
+	StageTimer(const StageTimer&) = delete;
+	StageTimer& operator=(const StageTimer&) = delete;
+
+private:
+	const Stage m_stage{};
+	const bool m_is_enabled{};
+	std::chrono::steady_clock::time_point m_start{};
+};
@@ -0,0 +1,56 @@
+#include "compact_note.h"
+
+#include "mx/api/NoteData.h"
+
+CompactNote::CompactNote(const mx::api::NoteData& note)
+	: m_duration_ticks{ static_cast<std::int32_t>(note.durationData.durationTimeTicks) },
+	m_step{ static_cast<std::int8_t>(note.pitchData.step) },
+	m_alter{ static_cast<std::int8_t>(note.pitchData.alter) },
+	m_octave{ static_cast<std::int8_t>(note.pitchData.octave) } {
+	if (note.isRest) {
+		m_flags |= rest_flag;
+	}
+	if (note.isTieStart) {
+		m_flags |= tie_start_flag;
+	}
+	if (note.isTieStop) {
+		m_flags |= tie_stop_flag;
+	}
+
+	m_spelling = static_cast<std::uint16_t>(note.pitchData.accidental) << 4;
+	m_spelling |= (note.pitchData.isAccidentalParenthetical ? 1 : 0);
+	m_spelling |= (note.pitchData.isAccidentalCautionary ? 2 : 0);
+	m_spelling |= (note.pitchData.isAccidentalEditorial ? 4 : 0);
+	m_spelling |= (note.pitchData.isAccidentalBracketed ? 8 : 0);
+}
+
+const mx::api::PitchData CompactNote::get_pitch_data() const {
+	mx::api::PitchData pitch{};
+	pitch.step = get_step();
+	pitch.alter = m_alter;
+	pitch.octave = m_octave;
+	return pitch;
+}
+
+void CompactNote::set_pitch(const mx::api::PitchData& pitch) {
+	m_step = static_cast<std::int8_t>(pitch.step);
+	m_alter = static_cast<std::int8_t>(pitch.alter);
+	m_octave = static_cast<std::int8_t>(pitch.octave);
+}
+
+const CompactVoice compact_voice(const std::vector<mx::api::NoteData>& voice) {
+	CompactVoice output{};
+	output.reserve(voice.size());
+	for (const mx::api::NoteData& note : voice) {
+		output.emplace_back(CompactNote{ note });
+	}
+	return output;
+}
+
+const CompactNote compact_rest(const int ticks) {
+	// Same pitch data as a freshly made rest, so it compares equal to the rests create_rest() and split_rests() make
+	mx::api::NoteData rest{};
+	rest.isRest = true;
+	rest.durationData.durationTimeTicks = ticks;
+	return CompactNote{ rest };
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "mx/api/NoteData.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+inline constexpr std::array<int, 7> white_key_semitones{ 0, 2, 4, 5, 7, 9, 11 }; // Semitones above C, indexed by mx::api::Step
+
+// The parts of mx::api::NoteData the counterpoint checker looks at, in 12 bytes instead of a few hundred.
+// Produced once from the leader; followers and sonorities only ever copy these
+class CompactNote {
+public:
+	CompactNote() = default;
+	explicit CompactNote(const mx::api::NoteData& note);
+
+	const bool is_rest() const {
+		return (m_flags & rest_flag) != 0;
+	}
+
+	const bool is_tie_start() const {
+		return (m_flags & tie_start_flag) != 0;
+	}
+
+	const bool is_tie_stop() const {
+		return (m_flags & tie_stop_flag) != 0;
+	}
+
+	const mx::api::Step get_step() const {
+		return static_cast<mx::api::Step>(m_step);
+	}
+
+	const int get_alter() const {
+		return m_alter;
+	}
+
+	const int get_octave() const {
+		return m_octave;
+	}
+
+	const int get_duration_ticks() const {
+		return m_duration_ticks;
+	}
+
+	constexpr int get_diatonic_index() const {
+		// Scale steps above C0
+		return 7 * m_octave + m_step;
+	}
+
+	constexpr int get_semitone_index() const {
+		// Semitones above C0. Not meaningful for rests
+		return 12 * m_octave + white_key_semitones[m_step] + m_alter;
+	}
+
+	void set_duration_ticks(const int value) {
+		m_duration_ticks = value;
+	}
+
+	void shift_octave(const int octaves) {
+		m_octave = static_cast<std::int8_t>(m_octave + octaves);
+	}
+
+	const mx::api::PitchData get_pitch_data() const; // Spelling bits aren't restored
+	void set_pitch(const mx::api::PitchData& pitch); // Only step, alter and octave. Keeps the original spelling, like shift() always did
+
+	const bool is_same_pitch(const CompactNote& other) const {
+		// Same as comparing mx::api::PitchData, except that cents are ignored
+		return m_step == other.m_step && m_alter == other.m_alter && m_octave == other.m_octave && m_spelling == other.m_spelling;
+	}
+
+private:
+	static constexpr std::uint8_t rest_flag{ 1 };
+	static constexpr std::uint8_t tie_start_flag{ 2 };
+	static constexpr std::uint8_t tie_stop_flag{ 4 };
+
+	std::int32_t m_duration_ticks{};
+	std::int8_t m_step{};
+	std::int8_t m_alter{};
+	std::int8_t m_octave{};
+	std::uint8_t m_flags{};
+	std::uint16_t m_spelling{}; // Accidental display (accidental, parenthetical, cautionary...). Two notes with the same pitch but different spelling count as different notes
+};
+
+using CompactVoice = std::vector<CompactNote>;
+
+const CompactVoice compact_voice(const std::vector<mx::api::NoteData>& voice);
+const CompactNote compact_rest(const int ticks);
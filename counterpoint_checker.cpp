@@ -1,16 +1,27 @@
 #include "counterpoint_checker.h"
 #include "settings.h"
 #include "canon.h"
+#include "checker_stats.h"
+#include "scratch_arena.h"
 
 #include "mx/api/ScoreData.h"
 
 #include <utility>
 #include <iostream>
 #include <cmath>
+#include <algorithm>
+#include <optional>
+#include <memory_resource>
 
 //#define DEBUG // When defined, all errors will show. Encountering an error will not call return
 
-void send_error_message(const Message& error, std::vector<Message>& error_message_box){
+// Scratch containers of one voice pair check, in the thread's ScratchArena
+using MessageBox = std::pmr::vector<Message>;
+using IndexArray = std::pmr::vector<int>; // Sonorities at or above one rhythmic hierarchy depth
+using IndexArrays = std::pmr::vector<IndexArray>;
+
+void send_error_message(const Rule rule, const Message& error, MessageBox& error_message_box){
+	count_rule_hit(rule); // Before the duplicate check, so every firing counts
 	for (Message& existing_error : error_message_box) {
 	// Check if a similar error message already exists
 		if (((existing_error.sonority_1_index) == (error.sonority_1_index)) && ((existing_error.sonority_2_index) == (error.sonority_2_index))) {
@@ -21,7 +32,8 @@ void send_error_message(const Message& error, std::vector<Message>& error_messag
 	error_message_box.emplace_back(error);
 }
 
-void send_warning_message(const Message& warning, std::vector<Message>& warning_message_box, std::vector<Message>& error_message_box) {
+void send_warning_message(const Rule rule, const Message& warning, MessageBox& warning_message_box, MessageBox& error_message_box) {
+	count_rule_hit(rule);
 	for (Message& existing_warning : warning_message_box) {
 		// Check if a similar warning OR error message already exists
 		if (((existing_warning.sonority_1_index) == (warning.sonority_1_index)) && ((existing_warning.sonority_2_index) == (warning.sonority_2_index))) {
@@ -39,9 +51,57 @@ void send_warning_message(const Message& warning, std::vector<Message>& warning_
 }
 
 
+// Start ticks of all dissonances found so far in the canon, shared by every voice pair. Remembers which ticks a
+// pair looked up and marked so its result can be cached and replayed (see VoicePairResult)
+class DissonanceStarts {
+public:
+	DissonanceStarts(std::pmr::vector<bool>& is_tick_dissonance_start)
+		: m_is_tick_dissonance_start{ is_tick_dissonance_start } {
+	}
+
+	const bool is_marked(const int tick) {
+		m_ticks_read.push_back(tick);
+		return m_is_tick_dissonance_start.at(tick);
+	}
+
+	void mark(const int tick) {
+		if (!m_is_tick_dissonance_start.at(tick)) {
+			m_is_tick_dissonance_start.at(tick) = true;
+			m_ticks_written.push_back(tick);
+		}
+	}
+
+	const bool read_only_own_marks() const {
+		// True if every tick this pair looked up was either unmarked or marked by this pair, i.e. the result doesn't depend on other pairs
+		for (const int tick : m_ticks_read) {
+			if (m_is_tick_dissonance_start.at(tick) && std::find(m_ticks_written.begin(), m_ticks_written.end(), tick) == m_ticks_written.end()) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	std::vector<int>& ticks_read() {
+		return m_ticks_read;
+	}
+
+	std::vector<int>& ticks_written() {
+		return m_ticks_written;
+	}
+
+	std::pmr::vector<bool>& marks() {
+		return m_is_tick_dissonance_start;
+	}
+
+private:
+	std::pmr::vector<bool>& m_is_tick_dissonance_start;
+	std::vector<int> m_ticks_read{};
+	std::vector<int> m_ticks_written{};
+};
+
 const int get_note_start_index(const int current_sonority_index, const int voice, const SonorityArray& sonority_array) {
 	for (int i{ current_sonority_index - 1 }; i >= 0; --i) {
-		if ((sonority_array.at(i).get_note_motion(voice).second != 0) || sonority_array.at(i).get_note(voice).isRest) {
+		if ((sonority_array.at(i).get_note_motion(voice).second != 0) || sonority_array.at(i).get_note(voice).is_rest()) {
 			return i + 1;
 			// Search until note isn't stationary or is a rest, then return the next note
 		}
@@ -51,7 +111,7 @@ const int get_note_start_index(const int current_sonority_index, const int voice
 
 const int get_note_end_index(const int current_sonority_index, const int voice, const SonorityArray& sonority_array) {
 	for (int i{ current_sonority_index }; i < sonority_array.size(); ++i) {
-		if (sonority_array.at(i).get_note(voice).isRest) {
+		if (sonority_array.at(i).get_note(voice).is_rest()) {
 			return i - 1;
 			// If encountering a rest, return the previous note
 		}
@@ -63,7 +123,7 @@ const int get_note_end_index(const int current_sonority_index, const int voice,
 	return current_sonority_index; // If no match, current sonority is the result
 }
 
-const bool are_upbeat_parallels_legal(const SonorityArray& sonority_array, const std::vector<int>& index_array, const Sonority& current_sonority, const int note_1_index, const int note_2_index, const std::pair<std::vector<int>, std::vector<int>>& dissonant_intervals) {
+const bool are_upbeat_parallels_legal(const SonorityArray& sonority_array, const IndexArray& index_array, const Sonority& current_sonority, const int note_1_index, const int note_2_index, const DissonantIntervals& dissonant_intervals) {
 	// Allow if there is a consonant suspension between the parallels
 	//if (sonority_array)
 	
@@ -130,235 +190,234 @@ const bool are_upbeat_parallels_legal(const SonorityArray& sonority_array, const
 	return false;
 }
 
-void check_voice_independence(const SonorityArray& sonority_array, std::vector<int> index_array, const std::pair<std::vector<int>, std::vector<int>>& dissonant_intervals, std::vector<Message>& error_message_box, std::vector<Message>& warning_message_box, const int ticks_per_measure, const int rhythmic_hierarchy_max_depth, const int rhythmic_hierarchy_of_beat, const std::size_t voice_count, const Key& key) {
-	for (int i{ 0 }; i < index_array.size() - 1; ++i) { // Subtract 1 because we don't want to check the last sonority
-		const Sonority& current_sonority{ sonority_array.at(index_array.at(i)) };
-		const Sonority& next_sonority{ (sonority_array).at(index_array.at(i + 1)) };
-
-		if (current_sonority.get_note_1().isRest ||
-			current_sonority.get_note_2().isRest ||
-			next_sonority.get_note_1().isRest ||
-			next_sonority.get_note_2().isRest ||
-			(current_sonority.get_note_1().pitchData.step == next_sonority.get_note_1().pitchData.step
-				&& current_sonority.get_note_1().pitchData.alter == next_sonority.get_note_1().pitchData.alter)
-			|| (current_sonority.get_note_2().pitchData.step == next_sonority.get_note_2().pitchData.step
-				&& current_sonority.get_note_2().pitchData.alter == next_sonority.get_note_2().pitchData.alter))
-			// If either voice doesn't move or moves by octaves
-		{
-			continue;
-		}
+const bool check_voice_independence_at(const SonorityArray& sonority_array, const SonorityMasks& masks, const IndexArray& index_array, const int i, const DissonantIntervals& dissonant_intervals, MessageBox& error_message_box, MessageBox& warning_message_box, const int ticks_per_measure, const int rhythmic_hierarchy_max_depth, const int rhythmic_hierarchy_of_beat, const std::size_t voice_count, const Key& key) {
+	// Rules from the i-th sonority of index_array to the ones after it. False after an error, which ends the level
+	const Sonority& current_sonority{ sonority_array.at(index_array.at(i)) };
+	const Sonority& next_sonority{ (sonority_array).at(index_array.at(i + 1)) };
+
+	if (test_bit(masks.get_rests(), index_array.at(i)) ||
+		test_bit(masks.get_rests(), index_array.at(i + 1)) ||
+		(current_sonority.get_note_1().get_step() == next_sonority.get_note_1().get_step()
+			&& current_sonority.get_note_1().get_alter() == next_sonority.get_note_1().get_alter())
+		|| (current_sonority.get_note_2().get_step() == next_sonority.get_note_2().get_step()
+			&& current_sonority.get_note_2().get_alter() == next_sonority.get_note_2().get_alter()))
+		// If either voice doesn't move or moves by octaves
+	{
+		return true;
+	}
 
 
-		// Avoid similar motion from a 2nd to a 3rd
-		// Remove? Warning?
-		if (current_sonority.get_motion_type() == similar
-			&& ((current_sonority.get_simple_interval().first == 1
-				&& next_sonority.get_simple_interval().first == 2)
-				// 2nd to 3rd
-				|| (current_sonority.get_simple_interval().first == 6
-					&& next_sonority.get_simple_interval().first == 5)))
-			// Inverted---7th to 6th
-		{
+	// Avoid similar motion from a 2nd to a 3rd
+	// Remove? Warning?
+	if (current_sonority.get_motion_type() == similar
+		&& ((current_sonority.get_simple_interval().first == 1
+			&& next_sonority.get_simple_interval().first == 2)
+			// 2nd to 3rd
+			|| (current_sonority.get_simple_interval().first == 6
+				&& next_sonority.get_simple_interval().first == 5)))
+		// Inverted---7th to 6th
+	{
 #ifdef DEBUG
-			std::cout << "Similar motion from a 2nd to a 3rd\n";
+		std::cout << "Similar motion from a 2nd to a 3rd\n";
 #endif // DEBUG
-			send_warning_message(Message{ current_sonority.get_index(), next_sonority.get_index() }, warning_message_box, error_message_box);
-		}
+		send_warning_message(Rule::similar_motion_second_to_third, Message{ current_sonority.get_index(), next_sonority.get_index() }, warning_message_box, error_message_box);
+	}
 
-		// Avoid more than 3 successive uses of the same interval in the same voices
-		try {
-			if (current_sonority.get_signed_compound_interval().first == next_sonority.get_signed_compound_interval().first
-				&& current_sonority.get_signed_compound_interval().first == sonority_array.at(index_array.at(i + 2)).get_signed_compound_interval().first
-				// If 3 successive uses of the same interval in the same voices
-				&& (i == 0 || current_sonority.get_compound_interval().first != sonority_array.at(index_array.at(i - 1)).get_compound_interval().first)
-				// If previous sonority isn't the same interval---ensures no duplicate warnings are raised if parallels continue for longer (CAN COMMENT THIS OUT IF WE WANT MULTIPLE WARNINGS)
-				)
-			{
-				if (voice_count > 2) {
-					// Allowed in 3+ parts
+	// Avoid more than 3 successive uses of the same interval in the same voices
+	try {
+		if (current_sonority.get_signed_compound_interval().first == next_sonority.get_signed_compound_interval().first
+			&& current_sonority.get_signed_compound_interval().first == sonority_array.at(index_array.at(i + 2)).get_signed_compound_interval().first
+			// If 3 successive uses of the same interval in the same voices
+			&& (i == 0 || current_sonority.get_compound_interval().first != sonority_array.at(index_array.at(i - 1)).get_compound_interval().first)
+			// If previous sonority isn't the same interval---ensures no duplicate warnings are raised if parallels continue for longer (CAN COMMENT THIS OUT IF WE WANT MULTIPLE WARNINGS)
+			)
+		{
+			if (voice_count > 2) {
+				// Allowed in 3+ parts
 #ifdef DEBUG
-					std::cout << "Parallel intervals for 4 or more notes (might continue beyond indicated final note)\n";
+				std::cout << "Parallel intervals for 4 or more notes (might continue beyond indicated final note)\n";
 #endif // DEBUG
-					send_warning_message(Message{ current_sonority.get_index(), sonority_array.at(index_array.at(i + 2)).get_index() }, warning_message_box, error_message_box);
-				}
-				else {
+				send_warning_message(Rule::parallel_intervals, Message{ current_sonority.get_index(), sonority_array.at(index_array.at(i + 2)).get_index() }, warning_message_box, error_message_box);
+			}
+			else {
 #ifdef DEBUG
-					std::cout << "Parallel intervals for 4 or more notes (might continue beyond indicated final note)\n";
+				std::cout << "Parallel intervals for 4 or more notes (might continue beyond indicated final note)\n";
 #endif // DEBUG
-					send_error_message(Message{ current_sonority.get_index(), sonority_array.at(index_array.at(i + 2)).get_index() }, error_message_box);
+				send_error_message(Rule::parallel_intervals, Message{ current_sonority.get_index(), sonority_array.at(index_array.at(i + 2)).get_index() }, error_message_box);
 #ifndef DEBUG
-					return;
+				return false;
 #endif
-				}
 			}
+		}
 /*
-		{
+	{
 #ifdef DEBUG
-			std::cout << "Parallel intervals for 4 or more notes (might continue beyond indicated final note)"\n;
+		std::cout << "Parallel intervals for 4 or more notes (might continue beyond indicated final note)"\n;
 #endif // DEBUG
-			send_warning_message(Message{ current_sonority.get_index(), sonority_array.at(index_array.at(i + 2)).get_index() }, warning_message_box, error_message_box);
+		send_warning_message(Rule::parallel_intervals, Message{ current_sonority.get_index(), sonority_array.at(index_array.at(i + 2)).get_index() }, warning_message_box, error_message_box);
 #ifndef DEBUG
-			return;
+		return false;
 #endif
-		}
+	}
 */
-		}
-		catch (...) {}
+	}
+	catch (...) {}
 
-		// Allow parallels if the faster voice leaps by more than a third from the first perfect interval. Overrides all other rules for parallels
-		bool parallels_allowed{ false };
-		if (index_array.at(i + 1) - index_array.at(i) >= 2) {
-			// There needs to be a gap between the two perfect consonances
-			for (int voice{ 0 }; voice < 2; ++voice) {
-				const int other_voice{ (voice == 0) ? 1 : 0 };
+	// Allow parallels if the faster voice leaps by more than a third from the first perfect interval. Overrides all other rules for parallels
+	bool parallels_allowed{ false };
+	if (index_array.at(i + 1) - index_array.at(i) >= 2) {
+		// There needs to be a gap between the two perfect consonances
+		for (int voice{ 0 }; voice < 2; ++voice) {
+			const int other_voice{ (voice == 0) ? 1 : 0 };
 
-				for (int j{ index_array.at(i) + 1 }; j < index_array.at(i + 1) - 1; ++j)
-					// For each intervening note
-				{
-					if ((std::abs(sonority_array.at(j).get_note_motion(voice).first) > 2)
-						// Leap of more than a third
-						&& (sonority_array.at(j).get_note_motion(other_voice).second == 0)
-						// Other voice cannot move
-						) {
+			for (int j{ index_array.at(i) + 1 }; j < index_array.at(i + 1) - 1; ++j)
+				// For each intervening note
+			{
+				if ((std::abs(sonority_array.at(j).get_note_motion(voice).first) > 2)
+					// Leap of more than a third
+					&& (sonority_array.at(j).get_note_motion(other_voice).second == 0)
+					// Other voice cannot move
+					) {
 #ifdef DEBUG
-						std::cout << "Parallels allowed: faster voice leaps by more than a third from the first perfect interval\n";
+					std::cout << "Parallels allowed: faster voice leaps by more than a third from the first perfect interval\n";
 #endif // DEBUG
-						parallels_allowed = true;
-					}
+					parallels_allowed = true;
 				}
 			}
 		}
-		if (parallels_allowed) {
-			continue;
-		}
+	}
+	if (parallels_allowed) {
+		return true;
+	}
 
-		// Avoid parallel fifths and octaves between adjacent notes.
-		if (current_sonority.get_simple_interval().second == 7 && next_sonority.get_simple_interval().second == 7) {
+	// Avoid parallel fifths and octaves between adjacent notes.
+	if (current_sonority.get_simple_interval().second == 7 && next_sonority.get_simple_interval().second == 7) {
 #ifdef DEBUG
-			std::cout << "Parallel fifths between adjacent notes or downbeats\n";
+		std::cout << "Parallel fifths between adjacent notes or downbeats\n";
 #endif // DEBUG
-			send_error_message(Message{ current_sonority.get_index(), next_sonority.get_index() }, error_message_box);
+		send_error_message(Rule::parallel_fifths, Message{ current_sonority.get_index(), next_sonority.get_index() }, error_message_box);
 #ifndef DEBUG
-			return;
+		return false;
 #endif
-		} else
-		if (current_sonority.get_simple_interval().first == 0 && next_sonority.get_simple_interval().first == 0) {
+	} else
+	if (current_sonority.get_simple_interval().first == 0 && next_sonority.get_simple_interval().first == 0) {
 #ifdef DEBUG
-			std::cout << "Parallel octaves between adjacent notes or downbeats\n";
+		std::cout << "Parallel octaves between adjacent notes or downbeats\n";
 #endif // DEBUG
-			send_error_message(Message{ current_sonority.get_index(), next_sonority.get_index() }, error_message_box);
+		send_error_message(Rule::parallel_octaves, Message{ current_sonority.get_index(), next_sonority.get_index() }, error_message_box);
 #ifndef DEBUG
-			return;
+		return false;
 #endif
-		}
+	}
 
-		// Avoid parallel fifths and octaves between any part of a beat and an accented note on the next beat.
-		std::vector<int> checked_rhythmic_levels{}; // Only get FIRST of any given downbeat level
-		if ((i == 0 || (sonority_array.at(index_array.at(i - 1)).get_note_1_motion().second != 0 && sonority_array.at(index_array.at(i - 1)).get_note_2_motion().second != 0))
-			// Allow if the first notes don't begin simultaneously
-			&& (current_sonority.get_rhythmic_hierarchy() >= rhythmic_hierarchy_of_beat))
-			// Allow if both first notes are offbeat
-		{
-			for (int j{ i + 1 };
-				j < (index_array.size())
-				&& (sonority_array.at(index_array.at(j)).get_index() - current_sonority.get_index() <= ticks_per_measure) // Search up to the end of the measure
-				&& (checked_rhythmic_levels.size() < (rhythmic_hierarchy_max_depth - current_sonority.get_rhythmic_hierarchy() - 1)); // End search when all rhythmic levels are found
-				++j) {
-				const Sonority& downbeat{ sonority_array.at(index_array.at(j)) };
-
-				if (downbeat.get_rhythmic_hierarchy() > current_sonority.get_rhythmic_hierarchy()
-					// If hierarchy level hasn't been checked yet
-					&& find(checked_rhythmic_levels.begin(), checked_rhythmic_levels.end(), downbeat.get_rhythmic_hierarchy()) == checked_rhythmic_levels.end()
-					&& !downbeat.is_sonority_dissonant(dissonant_intervals))
-				{
+	// Avoid parallel fifths and octaves between any part of a beat and an accented note on the next beat.
+	std::vector<int> checked_rhythmic_levels{}; // Only get FIRST of any given downbeat level
+	if ((i == 0 || (sonority_array.at(index_array.at(i - 1)).get_note_1_motion().second != 0 && sonority_array.at(index_array.at(i - 1)).get_note_2_motion().second != 0))
+		// Allow if the first notes don't begin simultaneously
+		&& (current_sonority.get_rhythmic_hierarchy() >= rhythmic_hierarchy_of_beat))
+		// Allow if both first notes are offbeat
+	{
+		for (int j{ i + 1 };
+			j < (index_array.size())
+			&& (sonority_array.at(index_array.at(j)).get_index() - current_sonority.get_index() <= ticks_per_measure) // Search up to the end of the measure
+			&& (checked_rhythmic_levels.size() < (rhythmic_hierarchy_max_depth - current_sonority.get_rhythmic_hierarchy() - 1)); // End search when all rhythmic levels are found
+			++j) {
+			const Sonority& downbeat{ sonority_array.at(index_array.at(j)) };
+
+			if (downbeat.get_rhythmic_hierarchy() > current_sonority.get_rhythmic_hierarchy()
+				// If hierarchy level hasn't been checked yet
+				&& find(checked_rhythmic_levels.begin(), checked_rhythmic_levels.end(), downbeat.get_rhythmic_hierarchy()) == checked_rhythmic_levels.end()
+				&& !test_bit(masks.get_dissonant(dissonant_intervals), index_array.at(j)))
+			{
 
-					if (current_sonority.get_simple_interval().second == 7 && downbeat.get_simple_interval().second == 7) {
+				if (current_sonority.get_simple_interval().second == 7 && downbeat.get_simple_interval().second == 7) {
 #ifdef DEBUG
-						std::cout << "Parallel fifths between weak beat and downbeat\n";
+					std::cout << "Parallel fifths between weak beat and downbeat\n";
 #endif // DEBUG
-						send_error_message(Message{ current_sonority.get_index(), downbeat.get_index() }, error_message_box);
+					send_error_message(Rule::parallel_fifths_to_downbeat, Message{ current_sonority.get_index(), downbeat.get_index() }, error_message_box);
 #ifndef DEBUG
-						return;
+					return false;
 #endif
-						checked_rhythmic_levels.push_back(downbeat.get_rhythmic_hierarchy());
-					}
-					else
-						if (current_sonority.get_simple_interval().first == 0 && downbeat.get_simple_interval().first == 0) {
+					checked_rhythmic_levels.push_back(downbeat.get_rhythmic_hierarchy());
+				}
+				else
+					if (current_sonority.get_simple_interval().first == 0 && downbeat.get_simple_interval().first == 0) {
 #ifdef DEBUG
-							std::cout << "Parallel octaves between weak beat and downbeat\n";
+						std::cout << "Parallel octaves between weak beat and downbeat\n";
 #endif // DEBUG
-							send_error_message(Message{ current_sonority.get_index(), downbeat.get_index() }, error_message_box);
+						send_error_message(Rule::parallel_octaves_to_downbeat, Message{ current_sonority.get_index(), downbeat.get_index() }, error_message_box);
 #ifndef DEBUG
-							return;
+						return false;
 #endif
-							checked_rhythmic_levels.push_back(downbeat.get_rhythmic_hierarchy());
-						}
-
-					if (!downbeat.is_sonority_dissonant(dissonant_intervals)) {
-						// Allow if intervening notes (current note is an intervening note for all future notes) are concords.
-						break;
+						checked_rhythmic_levels.push_back(downbeat.get_rhythmic_hierarchy());
 					}
+
+				if (!test_bit(masks.get_dissonant(dissonant_intervals), index_array.at(j))) {
+					// Allow if intervening notes (current note is an intervening note for all future notes) are concords.
+					break;
 				}
 			}
 		}
+	}
 
-		// Avoid parallel fifths and octaves between notes following adjacent accents, if voices are 2:1
-		for (int j{ i + 1 }; j < index_array.size(); ++j) {
-			const Sonority& next_upbeat{ sonority_array.at(index_array.at(j)) };
+	// Avoid parallel fifths and octaves between notes following adjacent accents, if voices are 2:1
+	for (int j{ i + 1 }; j < index_array.size(); ++j) {
+		const Sonority& next_upbeat{ sonority_array.at(index_array.at(j)) };
 
-			// Unless the gap between them is a measure or more (arbitrary line I drew)
-			if (next_upbeat.get_index() - current_sonority.get_index() >= ticks_per_measure) {
-				continue;
-			}
+		// Unless the gap between them is a measure or more (arbitrary line I drew)
+		if (next_upbeat.get_index() - current_sonority.get_index() >= ticks_per_measure) {
+			continue;
+		}
 
-			if (next_upbeat.get_rhythmic_hierarchy() == current_sonority.get_rhythmic_hierarchy()) {
-				if (current_sonority.get_simple_interval().second == 7 && next_upbeat.get_simple_interval().second == 7) {
-					if (!are_upbeat_parallels_legal(sonority_array, index_array, current_sonority, i, j, dissonant_intervals)) {
+		if (next_upbeat.get_rhythmic_hierarchy() == current_sonority.get_rhythmic_hierarchy()) {
+			if (current_sonority.get_simple_interval().second == 7 && next_upbeat.get_simple_interval().second == 7) {
+				if (!are_upbeat_parallels_legal(sonority_array, index_array, current_sonority, i, j, dissonant_intervals)) {
 #ifdef DEBUG
-						std::cout << "Parallel fifths between consecutive upbeats\n";
+					std::cout << "Parallel fifths between consecutive upbeats\n";
 #endif // DEBUG
-						send_error_message(Message{ current_sonority.get_index(), next_upbeat.get_index() }, error_message_box);
+					send_error_message(Rule::parallel_fifths_between_upbeats, Message{ current_sonority.get_index(), next_upbeat.get_index() }, error_message_box);
 #ifndef DEBUG
-						return;
+					return false;
 #endif
-					}
 				}
-				else
-					if (current_sonority.get_simple_interval().first == 0 && next_upbeat.get_simple_interval().first == 0) {
-						if (!are_upbeat_parallels_legal(sonority_array, index_array, current_sonority, i, j, dissonant_intervals)) {
+			}
+			else
+				if (current_sonority.get_simple_interval().first == 0 && next_upbeat.get_simple_interval().first == 0) {
+					if (!are_upbeat_parallels_legal(sonority_array, index_array, current_sonority, i, j, dissonant_intervals)) {
 #ifdef DEBUG
-							std::cout << "Parallel octaves between consecutive upbeats\n";
+						std::cout << "Parallel octaves between consecutive upbeats\n";
 #endif // DEBUG
-							send_error_message(Message{ current_sonority.get_index(), next_upbeat.get_index() }, error_message_box);
+						send_error_message(Rule::parallel_octaves_between_upbeats, Message{ current_sonority.get_index(), next_upbeat.get_index() }, error_message_box);
 #ifndef DEBUG
-							return;
+						return false;
 #endif
-						}
 					}
-				break;
-			}
+				}
+			break;
 		}
+	}
 
-		// Avoid following a perfect consonance with another one.
-		if ((current_sonority.get_simple_interval().second == 7 || current_sonority.get_simple_interval().second == 0)
-			&& (next_sonority.get_simple_interval().second == 7 || next_sonority.get_simple_interval().second == 0))
-		{
+	// Avoid following a perfect consonance with another one.
+	if ((current_sonority.get_simple_interval().second == 7 || current_sonority.get_simple_interval().second == 0)
+		&& (next_sonority.get_simple_interval().second == 7 || next_sonority.get_simple_interval().second == 0))
+	{
 #ifdef DEBUG
-			std::cout << "Consecutive perfect consonances\n";
+		std::cout << "Consecutive perfect consonances\n";
 #endif // DEBUG
-			send_warning_message(Message{ current_sonority.get_index(), next_sonority.get_index() }, warning_message_box, error_message_box);
-		}
+		send_warning_message(Rule::consecutive_perfect_consonances, Message{ current_sonority.get_index(), next_sonority.get_index() }, warning_message_box, error_message_box);
+	}
 
-		// Avoid doubled leading tone
-		if ((current_sonority.get_note_1().pitchData.step == key.leading_tone.step && current_sonority.get_note_1().pitchData.alter == key.leading_tone.alter)
-			&& (current_sonority.get_note_2().pitchData.step == key.leading_tone.step && current_sonority.get_note_2().pitchData.alter == key.leading_tone.alter))
-		{
+	// Avoid doubled leading tone
+	if ((current_sonority.get_note_1().get_step() == key.leading_tone.step && current_sonority.get_note_1().get_alter() == key.leading_tone.alter)
+		&& (current_sonority.get_note_2().get_step() == key.leading_tone.step && current_sonority.get_note_2().get_alter() == key.leading_tone.alter))
+	{
 #ifdef DEBUG
-			std::cout << "Doubled leading tone\n";
+		std::cout << "Doubled leading tone\n";
 #endif // DEBUG
-			send_warning_message(Message{ current_sonority.get_index(), current_sonority.get_index() }, warning_message_box, error_message_box);
-		}
+		send_warning_message(Rule::doubled_leading_tone, Message{ current_sonority.get_index(), current_sonority.get_index() }, warning_message_box, error_message_box);
 	}
+
+	return true;
 }
 
 const int max_rhythmic_hierarchy(const int first_note_start_sonority_index, const int second_note_sonority_index, const std::vector<int>& rhythmic_hierarchy_array) {
@@ -372,7 +431,7 @@ const int max_rhythmic_hierarchy(const int first_note_start_sonority_index, cons
 	return max;
 }
 
-void is_dissonance_allowed(const SonorityArray& sonority_array, const int i, const std::pair<std::vector<int>, std::vector<int>>& dissonant_intervals, std::vector<bool>& allowed_dissonances, const int ticks_per_measure, const Key& key, const std::vector<int>& rhythmic_hierarchy_array, std::vector<Message>& error_message_box, std::vector<Message>& warning_message_box) {
+void is_dissonance_allowed(const SonorityArray& sonority_array, const int i, const DissonantIntervals& dissonant_intervals, Bitset& allowed_dissonances, const int ticks_per_measure, const Key& key, const std::vector<int>& rhythmic_hierarchy_array, MessageBox& error_message_box, MessageBox& warning_message_box) {
 	// Decide whether to pass these directly
 	const Sonority& current_sonority{ sonority_array.at(i) };
 	const Sonority& next_sonority{ sonority_array.at(i + 1) };
@@ -385,16 +444,16 @@ void is_dissonance_allowed(const SonorityArray& sonority_array, const int i, con
 
 			if ((pedal_end - pedal_start >= 6)
 				// A pedal will be defined as a note that lasts (or repeats) through more than six pitch changes in other voices. Really it would be better to define it as a tone that is held through two or more changes of harmony, but for technical reasons we'll make this arbitrary definition.
-				&& ((sonority_array.at(pedal_start).get_note(voice).pitchData.step == key.tonic.step)
+				&& ((sonority_array.at(pedal_start).get_note(voice).get_step() == key.tonic.step)
 					// Pedal can be tonic
-					|| (sonority_array.at(pedal_start).get_note(voice).pitchData.step == key.dominant.step))
+					|| (sonority_array.at(pedal_start).get_note(voice).get_step() == key.dominant.step))
 				// Or dominant
 				&& (!sonority_array.at(pedal_start).is_sonority_dissonant(dissonant_intervals) && !sonority_array.at(pedal_end).is_sonority_dissonant(dissonant_intervals))
 				// Start and end must be consonant
 				)
 			{
 				for (int j{ pedal_start }; j <= pedal_end; ++j) {
-					allowed_dissonances.at(j) = true;
+					set_bit(allowed_dissonances, j);
 				}
 #ifdef DEBUG
 				std::cout << "pedal tone\n";
@@ -426,8 +485,8 @@ void is_dissonance_allowed(const SonorityArray& sonority_array, const int i, con
 #ifdef DEBUG
 					std::cout << "double passing tones\n";
 #endif // DEBUG
-					allowed_dissonances.at(i) = true;
-					allowed_dissonances.at(i + 1) = true;
+					set_bit(allowed_dissonances, i);
+					set_bit(allowed_dissonances, i + 1);
 					return;
 				}
 				if ((sonority_array.at(i - 1).get_note_motion(voice).first == -1)
@@ -445,8 +504,8 @@ void is_dissonance_allowed(const SonorityArray& sonority_array, const int i, con
 #ifdef DEBUG
 					std::cout << "anticipation with two dissonances\n";
 #endif // DEBUG
-					allowed_dissonances.at(i) = true;
-					allowed_dissonances.at(i + 1) = true;
+					set_bit(allowed_dissonances, i);
+					set_bit(allowed_dissonances, i + 1);
 					return;
 				}
 			}
@@ -487,7 +546,7 @@ void is_dissonance_allowed(const SonorityArray& sonority_array, const int i, con
 					std::cout << "downward cambiata\n";
 #endif // DEBUG
 					for (int j{ i }; j <= note_3_end; ++j) {
-						allowed_dissonances.at(j) = true;
+						set_bit(allowed_dissonances, j);
 					}
 					return;
 				}
@@ -500,7 +559,7 @@ void is_dissonance_allowed(const SonorityArray& sonority_array, const int i, con
 					std::cout << "inverted (upward) cambiata\n";
 #endif // DEBUG
 					for (int j{ i }; j <= note_3_end; ++j) {
-						allowed_dissonances.at(j) = true;
+						set_bit(allowed_dissonances, j);
 					}
 					return;
 				} else
@@ -516,7 +575,7 @@ void is_dissonance_allowed(const SonorityArray& sonority_array, const int i, con
 					std::cout << "double neighbor tone\n";
 #endif // DEBUG
 					for (int j{ i }; j <= note_3_end; ++j) {
-						allowed_dissonances.at(j) = true;
+						set_bit(allowed_dissonances, j);
 					}
 					return;
 				}
@@ -530,7 +589,7 @@ void is_dissonance_allowed(const SonorityArray& sonority_array, const int i, con
 #ifdef DEBUG
 		std::cout << "multiple consecutive dissonances error\n";
 #endif // DEBUG
-		allowed_dissonances.at(i) = false;
+		clear_bit(allowed_dissonances, i);
 		return;
 	}
 
@@ -554,7 +613,7 @@ void is_dissonance_allowed(const SonorityArray& sonority_array, const int i, con
 #ifdef DEBUG
 				std::cout << "passing/neighbor note\n";
 #endif // DEBUG
-				allowed_dissonances.at(i) = true;
+				set_bit(allowed_dissonances, i);
 				return;
 			}
 		}
@@ -578,8 +637,8 @@ void is_dissonance_allowed(const SonorityArray& sonority_array, const int i, con
 					}
 
 					// LEGAL RETARDATION
-					if (current_sonority.get_note(voice).pitchData.step == key.leading_tone.step && current_sonority.get_note(voice).pitchData.alter == key.leading_tone.alter
-						&& resolution.get_note(voice).pitchData.step == key.tonic.step && resolution.get_note(voice).pitchData.alter == key.tonic.alter) {
+					if (current_sonority.get_note(voice).get_step() == key.leading_tone.step && current_sonority.get_note(voice).get_alter() == key.leading_tone.alter
+						&& resolution.get_note(voice).get_step() == key.tonic.step && resolution.get_note(voice).get_alter() == key.tonic.alter) {
 						// If retardation resolves from leading tone to key.tonic
 
 						if (resolution.get_simple_interval().first == 0) {
@@ -587,13 +646,13 @@ void is_dissonance_allowed(const SonorityArray& sonority_array, const int i, con
 #ifdef DEBUG
 							std::cout << "Retardation resolution is doubled!\n";
 #endif // DEBUG
-							send_warning_message(Message{ current_sonority.get_index(), resolution.get_index() }, warning_message_box, error_message_box);
+							send_warning_message(Rule::doubled_retardation_resolution, Message{ current_sonority.get_index(), resolution.get_index() }, warning_message_box, error_message_box);
 						}
 						else {
 #ifdef DEBUG
 							std::cout << "retardation resolves up by semitone\n";
 #endif // DEBUG
-							allowed_dissonances.at(i) = true;
+							set_bit(allowed_dissonances, i);
 							return;
 						}
 					}
@@ -605,7 +664,7 @@ void is_dissonance_allowed(const SonorityArray& sonority_array, const int i, con
 						#ifndef DEBUG
 						return;
 						#endif
-						allowed_dissonances.at(i) = true; // Not actually allowed but we don't want it to complain again
+						set_bit(allowed_dissonances, i); // Not actually allowed but we don't want it to complain again
 						return;
 					}
 */
@@ -620,19 +679,19 @@ void is_dissonance_allowed(const SonorityArray& sonority_array, const int i, con
 #ifdef DEBUG
 							std::cout << "7-8 suspension\n";
 #endif // DEBUG
-							send_error_message(Message{ current_sonority.get_index(), resolution.get_index() }, error_message_box);
+							send_error_message(Rule::seven_eight_suspension, Message{ current_sonority.get_index(), resolution.get_index() }, error_message_box);
 						}
 						else if (resolution.get_simple_interval().first == 0 || resolution.get_simple_interval().second == 7) {
 #ifdef DEBUG
 							std::cout << "Suspension resolves to perfect consonance\n";
 #endif // DEBUG
-							send_warning_message(Message{ current_sonority.get_index(), resolution.get_index() }, warning_message_box, error_message_box);
+							send_warning_message(Rule::suspension_to_perfect_consonance, Message{ current_sonority.get_index(), resolution.get_index() }, warning_message_box, error_message_box);
 						}
 
 #ifdef DEBUG
 						std::cout << "suspension\n";
 #endif // DEBUG
-						allowed_dissonances.at(i) = true;
+						set_bit(allowed_dissonances, i);
 						return;
 					}
 				}
@@ -657,7 +716,7 @@ void is_dissonance_allowed(const SonorityArray& sonority_array, const int i, con
 					// Other voice must be the same at resolution
 					)
 				{
-					if ((sonority_array.at(i - 1).get_note(voice).isRest)
+					if ((sonority_array.at(i - 1).get_note(voice).is_rest())
 						// If preparation is rest
 						|| (sonority_array.at(i - 1).get_note_motion(voice).second * get_interval(current_sonority.get_note(voice), resolution.get_note(voice), true).second < 0)
 						// If preparation leaps in opposite direction
@@ -674,20 +733,20 @@ void is_dissonance_allowed(const SonorityArray& sonority_array, const int i, con
 #ifdef DEBUG
 								std::cout << "7-8 appogiatura\n";
 #endif // DEBUG
-								send_error_message(Message{ current_sonority.get_index(), resolution.get_index() }, error_message_box);
+								send_error_message(Rule::seven_eight_appoggiatura, Message{ current_sonority.get_index(), resolution.get_index() }, error_message_box);
 							}
 							else {
 								// Can't really resolve to a perfect 5th since other voice can't move
 #ifdef DEBUG
 								std::cout << "Appogiatura resolution is doubled!\n";
 #endif // DEBUG
-								send_warning_message(Message{ current_sonority.get_index(), resolution.get_index() }, warning_message_box, error_message_box);
+								send_warning_message(Rule::doubled_appoggiatura_resolution, Message{ current_sonority.get_index(), resolution.get_index() }, warning_message_box, error_message_box);
 							}
 						}
 #ifdef DEBUG
 						std::cout << "appogiatura\n";
 #endif // DEBUG
-						allowed_dissonances.at(i) = true;
+						set_bit(allowed_dissonances, i);
 						return;
 					}
 					else if (std::abs(sonority_array.at(i - 1).get_note_motion(voice).second) > 1) {
@@ -699,9 +758,9 @@ void is_dissonance_allowed(const SonorityArray& sonority_array, const int i, con
 #ifdef DEBUG
 							std::cout << "Appogiatura leaps in from the same direction!";
 #endif // DEBUG
-							send_warning_message(Message{ sonority_array.at(i - 1).get_index(), current_sonority.get_index() }, warning_message_box, error_message_box);
+							send_warning_message(Rule::appoggiatura_leap_same_direction, Message{ sonority_array.at(i - 1).get_index(), current_sonority.get_index() }, warning_message_box, error_message_box);
 						//}
-						allowed_dissonances.at(i) = true;
+						set_bit(allowed_dissonances, i);
 						return;
 					}
 				}
@@ -730,7 +789,7 @@ void is_dissonance_allowed(const SonorityArray& sonority_array, const int i, con
 #ifdef DEBUG
 				std::cout << "anticipation\n";
 #endif // DEBUG
-				allowed_dissonances.at(i) = true;
+				set_bit(allowed_dissonances, i);
 				return;
 			}
 		}
@@ -757,7 +816,7 @@ void is_dissonance_allowed(const SonorityArray& sonority_array, const int i, con
 				// Preparation moves by step
 				&& (!sonority_array.at(preparation_end).is_sonority_dissonant(dissonant_intervals))
 				// End of preparation must be consonant
-				&& (current_sonority.get_note(voice).durationData.durationTimeTicks <= current_sonority.get_index() - sonority_array.at(preparation_start).get_index())
+				&& (current_sonority.get_note(voice).get_duration_ticks() <= current_sonority.get_index() - sonority_array.at(preparation_start).get_index())
 				// Preparation must be longer than or equal in length to escape tone
 				&& (current_sonority.get_rhythmic_hierarchy() <= sonority_array.at(preparation_start).get_rhythmic_hierarchy() && current_sonority.get_rhythmic_hierarchy() <= next_sonority.get_rhythmic_hierarchy())
 				// Preparation must be on weak beat / upbeat
@@ -769,7 +828,7 @@ void is_dissonance_allowed(const SonorityArray& sonority_array, const int i, con
 #ifdef DEBUG
 				std::cout << "escape tone\n";
 #endif // DEBUG
-				allowed_dissonances.at(i) = true;
+				set_bit(allowed_dissonances, i);
 				return;
 			}
 		}
@@ -779,55 +838,46 @@ void is_dissonance_allowed(const SonorityArray& sonority_array, const int i, con
 	// If no rule explicitly says it's legal, use whatever value is already stored
 }
 
-void check_dissonance_handling(const std::pair<std::vector<int>, std::vector<int>>& dissonant_intervals, const SonorityArray& sonority_array, std::vector<Message>& error_message_box, std::vector<Message>& warning_message_box, std::vector<bool>& is_tick_dissonance_start, const bool write_to_is_tick_dissonance_start, const int ticks_per_measure, const Key& key, const std::vector<int>& rhythmic_hierarchy_array) {
-	// TODO: last sonority cannot be dissonant
-
-	std::vector<bool> allowed_dissonances(sonority_array.size());
-	// False: not allowed. True: allowed / warning
-	
-	for (int i{ 0 }; i < sonority_array.size() - 1; ++i) { // Subtract 1 because we don't want to check the last sonority
-
-		const Sonority& current_sonority{ sonority_array.at(i) };
-		const Sonority& next_sonority{ (sonority_array).at(i + 1) };
-
-		if (current_sonority.is_sonority_dissonant(dissonant_intervals)) {
-			const int current_sonority_index{ current_sonority.get_index() };
-			if (is_tick_dissonance_start.at(current_sonority_index)) {
-				// Simultaneous dissonances
-				send_error_message(Message{ current_sonority_index, current_sonority_index }, error_message_box);
+const bool check_dissonance_at(const SonorityArray& sonority_array, const int i, const DissonantIntervals& dissonant_intervals, Bitset& allowed_dissonances, MessageBox& error_message_box, MessageBox& warning_message_box, DissonanceStarts& dissonance_starts, const bool write_to_is_tick_dissonance_start, const int ticks_per_measure, const Key& key, const std::vector<int>& rhythmic_hierarchy_array) {
+	// Handling of the dissonant i-th sonority. False after a simultaneous dissonance, which ends the dissonance checks
+	const int current_sonority_index{ sonority_array.at(i).get_index() };
+	if (dissonance_starts.is_marked(current_sonority_index)) {
+		// Simultaneous dissonances
+		send_error_message(Rule::simultaneous_dissonance, Message{ current_sonority_index, current_sonority_index }, error_message_box);
 #ifndef DEBUG
-				return;
+		return false;
 #endif // !DEBUG
 
-			}
-			if (write_to_is_tick_dissonance_start) {
-				is_tick_dissonance_start.at(current_sonority_index) = true;
-			}
-			is_dissonance_allowed(sonority_array, i, dissonant_intervals, allowed_dissonances, ticks_per_measure, key, rhythmic_hierarchy_array, error_message_box, warning_message_box);
-				// If not allowed, is_dissonance_allowed will mark it as so
-		}
-		else {
-			allowed_dissonances.at(i) = true;
-		}
 	}
+	if (write_to_is_tick_dissonance_start) {
+		dissonance_starts.mark(current_sonority_index);
+	}
+	is_dissonance_allowed(sonority_array, i, dissonant_intervals, allowed_dissonances, ticks_per_measure, key, rhythmic_hierarchy_array, error_message_box, warning_message_box);
+		// If not allowed, is_dissonance_allowed will mark it as so
+	return true;
+}
+
+void check_illegal_dissonances(const SonorityArray& sonority_array, const Bitset& dissonant_sonorities, Bitset& allowed_dissonances, MessageBox& error_message_box) {
+	// After every dissonance has been handled, the ones no rule allowed are errors
+	const int last{ static_cast<int>(sonority_array.size()) - 1 };
 
 	// Last sonority
-	{
-		const std::size_t i{ sonority_array.size() - 1 };
-		if (sonority_array.at(i).is_sonority_dissonant(dissonant_intervals)) {
-			allowed_dissonances.at(i) = false;
-		}
-		else {
-			allowed_dissonances.at(i) = true;
-		}
+	if (test_bit(dissonant_sonorities, last)) {
+		clear_bit(allowed_dissonances, last);
+	}
+	else {
+		set_bit(allowed_dissonances, last);
 	}
 
-	for (int i{ 0 }; i < allowed_dissonances.size(); ++i) {
-		if (allowed_dissonances.at(i) == false) {
+	for (std::size_t word{ 0 }; word < allowed_dissonances.size(); ++word) {
+		const std::size_t bits_in_word{ std::min<std::size_t>(64, sonority_array.size() - 64 * word) };
+		const std::uint64_t valid_bits{ (bits_in_word == 64) ? ~std::uint64_t{ 0 } : ((std::uint64_t{ 1 } << bits_in_word) - 1) };
+		for (std::uint64_t bits{ ~allowed_dissonances.at(word) & valid_bits }; bits != 0; bits &= bits - 1) {
+			const int i{ static_cast<int>(64 * word) + lowest_set_bit(bits) };
 #ifdef DEBUG
 			std::cout << "Illegal dissonance\n";
 #endif // DEBUG
-			send_error_message(Message{ sonority_array.at(i).get_index(), sonority_array.at(i).get_index() }, error_message_box);
+			send_error_message(Rule::illegal_dissonance, Message{ sonority_array.at(i).get_index(), sonority_array.at(i).get_index() }, error_message_box);
 			#ifndef DEBUG
 			return;
 			#endif
@@ -835,390 +885,568 @@ void check_dissonance_handling(const std::pair<std::vector<int>, std::vector<int
 	}
 }
 
-void check_with_given_config(const std::pair<std::vector<int>, std::vector<int>>& dissonant_intervals, std::vector<Message>& error_message_box, std::vector<Message>& warning_message_box, const std::vector<std::vector<int>>& index_arrays_for_sonority_arrays, const SonorityArray& stripped_sonority_array, std::vector<bool>& is_tick_dissonance_start, const bool write_to_is_tick_dissonance_start, const int ticks_per_measure, const Key& key, const std::vector<int>& rhythmic_hierarchy_array, const int rhythmic_hierarchy_max_depth, const int rhythmic_hierarchy_of_beat, const std::size_t voice_count) {
-	for (std::vector<int> index_array : index_arrays_for_sonority_arrays) {
-		if (index_array.size() > 0) {
-			check_voice_independence(stripped_sonority_array, index_array, dissonant_intervals, error_message_box, warning_message_box, ticks_per_measure, rhythmic_hierarchy_max_depth, rhythmic_hierarchy_of_beat, voice_count, key);
-		}
-	}
-	check_dissonance_handling(dissonant_intervals, stripped_sonority_array, error_message_box, warning_message_box, is_tick_dissonance_start, write_to_is_tick_dissonance_start, ticks_per_measure, key, rhythmic_hierarchy_array); // Only check lowest level
-}
+void check_with_given_config(const DissonantIntervals& dissonant_intervals, MessageBox& error_message_box, MessageBox& warning_message_box, const IndexArrays& index_arrays_for_sonority_arrays, const SonorityArray& stripped_sonority_array, const SonorityMasks& masks, DissonanceStarts& dissonance_starts, const bool write_to_is_tick_dissonance_start, const int ticks_per_measure, const Key& key, const std::vector<int>& rhythmic_hierarchy_array, const int rhythmic_hierarchy_max_depth, const int rhythmic_hierarchy_of_beat, const std::size_t voice_count) {
+	// One walk over the sonorities checks voice independence on every rhythmic hierarchy level and dissonance
+	// handling on the lowest one. Each check still stops at its own first error, as it would on its own
+	// TODO: last sonority cannot be dissonant
+	const Bitset& dissonant_sonorities{ masks.get_dissonant(dissonant_intervals) };
+	const int last{ static_cast<int>(stripped_sonority_array.size()) - 1 }; // We don't want to check the last sonority
 
-void check_outer_voice(const SonorityArray& sonority_array, std::vector<int> index_array, const int outer_voice, std::vector<Message>& error_message_box, std::vector<Message>& warning_message_box) {
-	const int inner_voice{ (outer_voice == 0) ? 1 : 0 };
+	// Set: allowed / warning. Consonances start out allowed, and is_dissonance_allowed sets the dissonances it accepts
+	Bitset allowed_dissonances(dissonant_sonorities.size());
+	for (std::size_t word{ 0 }; word < allowed_dissonances.size(); ++word) {
+		allowed_dissonances.at(word) = ~dissonant_sonorities.at(word);
+	}
 
-	for (int i{ 0 }; i < index_array.size() - 1; ++i) { // Subtract 1 because we don't want to check the last sonority
-		const Sonority& current_sonority{ sonority_array.at(index_array.at(i)) };
-		const Sonority& next_sonority{ (sonority_array).at(index_array.at(i + 1)) };
+	// Position of each level's next sonority in its index array. A level that is done is moved to its end
+	std::pmr::vector<int> next_positions(index_arrays_for_sonority_arrays.size(), 0, index_arrays_for_sonority_arrays.get_allocator().resource());
+	bool is_dissonance_handling_done{ false };
 
-	// Avoid "direct"or "hidden" 5ths or 8vas (similar motion to those intervals).
-		if ((get_interval(current_sonority.get_note_1(), next_sonority.get_note_1(), true).second * get_interval(current_sonority.get_note_2(), next_sonority.get_note_2(), true).second > 0)
-			// If similar motion
-			&& (next_sonority.get_simple_interval().second == 7 || next_sonority.get_simple_interval().second == 0)
-			// If next sonority is a perfect consonance
-			)
-		{
-			if (!(std::abs(current_sonority.get_note_motion(outer_voice).first) <= 1))
-				// Allow if one voice is inner and exposed voice moves by step
-			{
-#ifdef DEBUG
-				std::cout << "Direct fifths or octaves between outer and inner voice\n";
-#endif // DEBUG
-				send_warning_message(Message{ current_sonority.get_index(), next_sonority.get_index() }, warning_message_box, error_message_box);
-				// Error or warning?
+	for (int i{ 0 }; i <= last; ++i) {
+		for (std::size_t depth{ 0 }; depth < index_arrays_for_sonority_arrays.size(); ++depth) {
+			const IndexArray& index_array{ index_arrays_for_sonority_arrays.at(depth) };
+			int& position{ next_positions.at(depth) };
+			if (position + 1 >= index_array.size() || index_array.at(position) != i) {
+				continue; // Done, or i isn't on this level
+			}
+			if (check_voice_independence_at(stripped_sonority_array, masks, index_array, position, dissonant_intervals, error_message_box, warning_message_box, ticks_per_measure, rhythmic_hierarchy_max_depth, rhythmic_hierarchy_of_beat, voice_count, key)) {
+				++position;
 			}
-#ifdef DEBUG
 			else {
-				std::cout << "Direct fifths allowed between outer and inner voice: one voice is inner and exposed voice moves by step\n";
+				position = static_cast<int>(index_array.size());
 			}
-#endif // DEBUG
-
 		}
 
-	// Avoid leaping motion in two voices moving to a perfect interval. ONLY IF INNER PART
-		if (std::abs(current_sonority.get_note_1_motion().first) != 1 &&
-			std::abs(current_sonority.get_note_2_motion().first) != 1) {
-			if (next_sonority.get_simple_interval().second == 7) {
-#ifdef DEBUG
-				std::cout << "Both voices leap to a perfect fifth\n";
-#endif // DEBUG
-				send_warning_message(Message{ current_sonority.get_index(), next_sonority.get_index() }, warning_message_box, error_message_box);
-#ifndef DEBUG
-				return;
-#endif 
-			}
-		else
-			if (next_sonority.get_simple_interval().second == 0) {
-#ifdef DEBUG
-				std::cout << "Both voices leap to an octave\n";
-#endif // DEBUG
-				send_warning_message(Message{ current_sonority.get_index(), next_sonority.get_index() }, warning_message_box, error_message_box);
-#ifndef DEBUG
-				return;
-#endif
-			}
+		if (!is_dissonance_handling_done && i < last && test_bit(dissonant_sonorities, i)) {
+			is_dissonance_handling_done = !check_dissonance_at(stripped_sonority_array, i, dissonant_intervals, allowed_dissonances, error_message_box, warning_message_box, dissonance_starts, write_to_is_tick_dissonance_start, ticks_per_measure, key, rhythmic_hierarchy_array);
 		}
 	}
+
+	if (!is_dissonance_handling_done) {
+		check_illegal_dissonances(stripped_sonority_array, dissonant_sonorities, allowed_dissonances, error_message_box);
+	}
 }
 
-void check_outer_voice_pair(const SonorityArray& sonority_array, std::vector<int> index_array, std::vector<Message>& error_message_box, std::vector<Message>& warning_message_box, const int voice_count) {
-	for (int i{ 0 }; i < index_array.size() - 1; ++i) {
-		const Sonority& current_sonority{ sonority_array.at(index_array.at(i)) };
-		const Sonority& next_sonority{ (sonority_array).at(index_array.at(i + 1)) };
+struct MessageBoxes {
+	MessageBox error_message_box;
+	MessageBox warning_message_box;
 
-		const int upper_voice{ (current_sonority.get_signed_compound_interval().second < 0) ? 0 : 1 };
+	explicit MessageBoxes(std::pmr::memory_resource* scratch)
+		: error_message_box{ scratch }, warning_message_box{ scratch } {
+	}
 
-		if ((get_interval(current_sonority.get_note_1(), next_sonority.get_note_1(), true).second * get_interval(current_sonority.get_note_2(), next_sonority.get_note_2(), true).second > 0))
-			// If similar motion
-		{
-			if (next_sonority.get_simple_interval().second == 0)
-				// Direct octaves
-			{
-				if ((!(std::abs(current_sonority.get_note_motion(upper_voice).first) <= 1))
-					// Allow if upper voice moves by step
-					|| (voice_count > 3)
-					// And 4 or more voices
-					)
-				{
-					if ((voice_count == 2)
-						// If two voices
-						|| (current_sonority.get_rhythmic_hierarchy() < next_sonority.get_rhythmic_hierarchy())
-						// Second interval is on downbeat
-						) {
-#ifdef DEBUG
-						std::cout << "Direct octaves between outer voices\n";
-#endif // DEBUG
-						send_error_message(Message{ current_sonority.get_index(), next_sonority.get_index() }, error_message_box);
-					}
-					else {
+	const bool is_invalid(const std::size_t warning_threshold) const {
+		return error_message_box.size() > 0 || warning_message_box.size() > warning_threshold;
+	}
+};
+
+void check_outer_voices(const SonorityArray& sonority_array, const SonorityMasks& masks, const IndexArrays& index_arrays_for_sonority_arrays, MessageBoxes* outer_voice_0, MessageBoxes* outer_voice_1, MessageBoxes* outer_voice_pair, const int voice_count) {
+	// Rules for outer voices, for each role of one inversion at once: voice 0 as the only outer voice, voice 1 as the
+	// only outer voice, and both as outer voices. nullptr skips a role. Each rhythmic hierarchy level is walked once
+	for (const IndexArray& index_array : index_arrays_for_sonority_arrays) {
+		if (index_array.size() == 0) {
+			continue;
+		}
+
+		// A single outer voice stops being checked on this level after the first leap to a perfect interval
+		bool is_outer_voice_done[2]{ outer_voice_0 == nullptr, outer_voice_1 == nullptr };
+		MessageBoxes* const outer_voice_boxes[2]{ outer_voice_0, outer_voice_1 };
+
+		for (int i{ 0 }; i < index_array.size() - 1; ++i) { // Subtract 1 because we don't want to check the last sonority
+			if (!test_bit(masks.get_perfect_consonances(), index_array.at(i + 1))) {
+				continue; // Every rule here is about moving into a perfect consonance
+			}
+
+			const Sonority& current_sonority{ sonority_array.at(index_array.at(i)) };
+			const Sonority& next_sonority{ (sonority_array).at(index_array.at(i + 1)) };
+			const Message message{ current_sonority.get_index(), next_sonority.get_index() };
+
+			const bool is_similar_motion{ get_interval(current_sonority.get_note_1(), next_sonority.get_note_1(), true).second * get_interval(current_sonority.get_note_2(), next_sonority.get_note_2(), true).second > 0 };
+			const int next_simple_semitones{ next_sonority.get_simple_interval().second };
+
+			for (int outer_voice{ 0 }; outer_voice < 2; ++outer_voice) {
+				if (is_outer_voice_done[outer_voice]) {
+					continue;
+				}
+				MessageBoxes& boxes{ *outer_voice_boxes[outer_voice] };
+
+			// Avoid "direct"or "hidden" 5ths or 8vas (similar motion to those intervals).
+				if (is_similar_motion
+					&& (next_simple_semitones == 7 || next_simple_semitones == 0)
+					// If next sonority is a perfect consonance
+					&& !(std::abs(current_sonority.get_note_motion(outer_voice).first) <= 1)
+					// Allow if one voice is inner and exposed voice moves by step
+					) {
 #ifdef DEBUG
-						std::cout << "Direct octaves between outer voices\n";
+					std::cout << "Direct fifths or octaves between outer and inner voice\n";
 #endif // DEBUG
-						send_warning_message(Message{ current_sonority.get_index(), next_sonority.get_index() }, warning_message_box, error_message_box);
-					}
+					send_warning_message(Rule::direct_perfect_interval_outer_inner, message, boxes.warning_message_box, boxes.error_message_box);
+					// Error or warning?
 				}
+
+			// Avoid leaping motion in two voices moving to a perfect interval. ONLY IF INNER PART
+				if (std::abs(current_sonority.get_note_1_motion().first) != 1
+					&& std::abs(current_sonority.get_note_2_motion().first) != 1
+					&& (next_simple_semitones == 7 || next_simple_semitones == 0)) {
 #ifdef DEBUG
-				else {
-					std::cout << "Direct octaves allowed between outer voices: 4 or more voices, upper voice moves by step\n";
-				}
+					std::cout << "Both voices leap to a perfect fifth or octave\n";
 #endif // DEBUG
+					send_warning_message(Rule::leap_to_perfect_interval, message, boxes.warning_message_box, boxes.error_message_box);
+#ifndef DEBUG
+					is_outer_voice_done[outer_voice] = true;
+#endif
+				}
 			}
 
-			if (next_sonority.get_simple_interval().second == 7) {
-				// Direct fifths
-				if (!(std::abs(current_sonority.get_note_motion(upper_voice).first) <= 1))
-					// Allow if upper voice moves by step
-				{
-					if ((voice_count == 2)
-						// If two voices
-						|| (current_sonority.get_rhythmic_hierarchy() < next_sonority.get_rhythmic_hierarchy())
-						// Second interval is on downbeat
-						) {
-#ifdef DEBUG
-						std::cout << "Direct fifths between outer voices\n";
-#endif // DEBUG
-						send_error_message(Message{ current_sonority.get_index(), next_sonority.get_index() }, error_message_box);
-					}
-					else {
+			if (outer_voice_pair == nullptr || !is_similar_motion) {
+				continue;
+			}
+
+			const int upper_voice{ (current_sonority.get_signed_compound_interval().second < 0) ? 0 : 1 };
+			const bool is_upper_voice_step{ std::abs(current_sonority.get_note_motion(upper_voice).first) <= 1 };
+			const bool is_error{ (voice_count == 2)
+				// If two voices
+				|| (current_sonority.get_rhythmic_hierarchy() < next_sonority.get_rhythmic_hierarchy())
+				// Second interval is on downbeat
+			};
+
+			if ((next_simple_semitones == 0 && (!is_upper_voice_step || voice_count > 3))
+				// Direct octaves. Allowed if the upper voice moves by step, with fewer than 4 voices
+				|| (next_simple_semitones == 7 && !is_upper_voice_step)
+				// Direct fifths. Allowed if the upper voice moves by step
+				) {
 #ifdef DEBUG
-						std::cout << "Direct fifths between outer voices\n";
+				std::cout << "Direct fifths or octaves between outer voices\n";
 #endif // DEBUG
-						send_warning_message(Message{ current_sonority.get_index(), next_sonority.get_index() }, warning_message_box, error_message_box);
-					}
+				if (is_error) {
+					send_error_message(Rule::direct_perfect_interval_outer_voices, message, outer_voice_pair->error_message_box);
 				}
-#ifdef DEBUG
 				else {
-					std::cout << "Direct fifths allowed between outer voices: upper voice moves by step\n";
+					send_warning_message(Rule::direct_perfect_interval_outer_voices, message, outer_voice_pair->warning_message_box, outer_voice_pair->error_message_box);
 				}
-#endif // DEBUG
 			}
 		}
 	}
 }
 
-void check_counterpoint(Canon& canon, const int ticks_per_measure, const Key& key, const std::vector<int>& rhythmic_hierarchy_array, const int rhythmic_hierarchy_max_depth, const int rhythmic_hierarchy_of_beat, const Settings& settings) {
-	// NOTE: Only use higher rhythmic levels to check for PARALLELS
-	// This doesn't care about whether which voice is the bass. It assumes the composer can add another bass voice
-	// Return type is a pair of lists of error and warning messages
-	const std::size_t voice_count{ canon.texture().size() };
-
-	// For every voice, generate per-tick note data. MAKES COPIES
-	std::vector<std::vector<mx::api::NoteData>> notes_by_tick(voice_count); // Indexed by tick. Ordering of voices doesn't really matter
-	for (int i{ 0 }; i < voice_count; ++i) {
-		std::vector<mx::api::NoteData> notes_by_tick_for_voice{}; // TODO: predetermine vector size
-		for (const mx::api::NoteData& note : canon.texture().at(i)) {
-			for (int j{ 0 }; j < note.durationData.durationTimeTicks; ++j) { // Append as many times as the number of ticks the note lasts for
-				notes_by_tick_for_voice.emplace_back(note);
-			}
-		}
-		notes_by_tick.at(i) = (notes_by_tick_for_voice);
-	}
-
-	// Get every unordered combination of two voices
-	std::vector<std::pair<int, int>> voice_pairs{};
-	for (int i{ 0 }; i < voice_count; ++i) {
-		for (int j{ i + 1 }; j < voice_count; ++j) {
-			voice_pairs.emplace_back(std::pair<int, int>{i, j});
+const SonorityArray create_stripped_sonority_array(const CanonVoice& voice_1, const CanonVoice& voice_2, const int ticks_per_measure, const std::vector<int>& rhythmic_hierarchy_array, std::pmr::memory_resource* scratch) {
+	// One sonority per tick, minus the ones identical to the tick before and the ones with two rests. Between two
+	// note starts (in either voice) every tick is identical, so only the ticks where a note starts are visited.
+	// Sonority indices are still ticks
+	SonorityArray stripped_sonority_array{ scratch };
+	std::size_t note_1{ 0 };
+	std::size_t note_2{ 0 };
+	int note_1_end{ 0 };
+	int note_2_end{ 0 };
+	int tick{ 0 };
+	std::optional<Sonority> previous_sonority{};
+	while (true) {
+		// Move to the notes sounding at tick. Notes without ticks are skipped, like they would be per tick
+		while (note_1 < voice_1.size() && note_1_end + voice_1.at(note_1).get_duration_ticks() <= tick) {
+			note_1_end += voice_1.at(note_1).get_duration_ticks();
+			++note_1;
 		}
-	}
-
-	// Start ticks of all dissonances
-	std::vector<bool> is_tick_dissonance_start(notes_by_tick.at(0).size());
-
-	// FOR EACH PAIR OF VOICES {
-	for (const std::pair<int, int>& voice_pair : voice_pairs) {
-		// (different pairs of voices will have different strippings)
-			// Generate raw unstripped sonority array
-		const Voice& voice_1{ notes_by_tick.at(voice_pair.first) };
-		const Voice& voice_2{ notes_by_tick.at(voice_pair.second) };
-		SonorityArray raw_sonority_array{};
-		for (int i{ 0 }; i < voice_1.size() && i < voice_2.size(); ++i) {
-			raw_sonority_array.emplace_back(Sonority{ voice_1.at(i), voice_2.at(i), rhythmic_hierarchy_array.at(i % ticks_per_measure), i });
+		while (note_2 < voice_2.size() && note_2_end + voice_2.at(note_2).get_duration_ticks() <= tick) {
+			note_2_end += voice_2.at(note_2).get_duration_ticks();
+			++note_2;
 		}
-		// Generate downbeat sonority arrays
-		SonorityArray stripped_sonority_array{};
-		stripped_sonority_array.emplace_back(raw_sonority_array.at(0)); // Always push the first
-		for (int i{ 1 }; i < raw_sonority_array.size(); ++i) {
-			const Sonority current_sonority{ raw_sonority_array.at(i) };
-			if (!is_identical(raw_sonority_array.at(i - 1), current_sonority)
-				&& current_sonority.get_num_rests() != 2
-				// Delete if two rests, or one rest and the other voice is stationary
-				) {
-				stripped_sonority_array.emplace_back(raw_sonority_array.at(i));
-			}
+		if (note_1 >= voice_1.size() || note_2 >= voice_2.size()) {
+			break;
 		}
 
-		for (int i{ 0 }; i < stripped_sonority_array.size() - 1; ++i) {
-			stripped_sonority_array.at(i).build_motion_data(stripped_sonority_array.at(i + 1));
+		const Sonority current_sonority{ voice_1.at(note_1), voice_2.at(note_2), rhythmic_hierarchy_array.at(tick % ticks_per_measure), tick };
+		if (!previous_sonority) {
+			stripped_sonority_array.emplace_back(current_sonority); // Always push the first
+		}
+		else if (!is_identical(*previous_sonority, current_sonority)
+			&& current_sonority.get_num_rests() != 2
+			// Delete if two rests, or one rest and the other voice is stationary
+			) {
+			stripped_sonority_array.emplace_back(current_sonority);
 		}
+		previous_sonority.emplace(current_sonority); // The tick before the next note start sounds the same as this one
 
-		std::vector<std::vector<int>> index_arrays_for_sonority_arrays{};
-		for (int depth{ 0 }; depth <= rhythmic_hierarchy_max_depth; ++depth) {
-			std::vector<int> index_array_at_depth{};
-			for (int i{ 0 }; i < stripped_sonority_array.size(); ++i) {
-				if (depth <= stripped_sonority_array.at(i).get_rhythmic_hierarchy()) {
-					index_array_at_depth.emplace_back(i);
-				}
-			}
+		tick = std::min(note_1_end + voice_1.at(note_1).get_duration_ticks(), note_2_end + voice_2.at(note_2).get_duration_ticks());
+	}
 
-			index_arrays_for_sonority_arrays.emplace_back(index_array_at_depth);
-		}
+	return stripped_sonority_array;
+}
 
-		// Get the two inversions
-		SonorityArray sonority_array_21{ stripped_sonority_array }; // Voice 2 in the bass
-		int sa_21_max_octave_difference{ 0 };
-		for (const Sonority& sonority : sonority_array_21) {
-			const int octave_difference{ sonority.get_note_2().pitchData.octave - sonority.get_note_1().pitchData.octave };
-			if (octave_difference > sa_21_max_octave_difference) {
-				sa_21_max_octave_difference = octave_difference;
+// The two inversions of one pair of voices, in the scratch arena
+struct Inversions {
+	IndexArrays index_arrays_for_sonority_arrays;
+	SonorityArray sonority_array_21; // Voice 2 in the bass
+	SonorityArray sonority_array_12; // Voice 1 in the bass
+	SonorityMasks masks_21;
+	SonorityMasks masks_12;
+};
+
+Inversions create_inversions(const CanonVoice& voice_1, const CanonVoice& voice_2, const int ticks_per_measure, const std::vector<int>& rhythmic_hierarchy_array, const int rhythmic_hierarchy_max_depth, std::pmr::memory_resource* scratch) {
+	// (different pairs of voices will have different strippings)
+	SonorityArray stripped_sonority_array{ create_stripped_sonority_array(voice_1, voice_2, ticks_per_measure, rhythmic_hierarchy_array, scratch) };
+
+	build_motion_data(stripped_sonority_array);
+
+	IndexArrays index_arrays_for_sonority_arrays{ scratch };
+	for (int depth{ 0 }; depth <= rhythmic_hierarchy_max_depth; ++depth) {
+		IndexArray index_array_at_depth{ scratch };
+		for (int i{ 0 }; i < stripped_sonority_array.size(); ++i) {
+			if (depth <= stripped_sonority_array.at(i).get_rhythmic_hierarchy()) {
+				index_array_at_depth.emplace_back(i);
 			}
 		}
-		for (Sonority& sonority : sonority_array_21) {
-			sonority.note_1().pitchData.octave += (sa_21_max_octave_difference + 1);
-		}
 
-		SonorityArray sonority_array_12{ stripped_sonority_array }; // Voice 1 in the bass
-		int sa_12_max_octave_difference{ 0 };
-		for (const Sonority& sonority : sonority_array_12) {
-			const int octave_difference{ sonority.get_note_1().pitchData.octave - sonority.get_note_2().pitchData.octave };
-			if (octave_difference > sa_12_max_octave_difference) {
-				sa_12_max_octave_difference = octave_difference;
-			}
+		index_arrays_for_sonority_arrays.emplace_back(std::move(index_array_at_depth));
+	}
+
+	// Get the two inversions
+	SonorityArray sonority_array_21{ stripped_sonority_array, scratch }; // Voice 2 in the bass
+	int sa_21_max_octave_difference{ 0 };
+	for (const Sonority& sonority : sonority_array_21) {
+		const int octave_difference{ sonority.get_note_2().get_octave() - sonority.get_note_1().get_octave() };
+		if (octave_difference > sa_21_max_octave_difference) {
+			sa_21_max_octave_difference = octave_difference;
 		}
-		for (Sonority& sonority : sonority_array_12) {
-			sonority.note_2().pitchData.octave += (sa_12_max_octave_difference + 1);
+	}
+	shift_voice_octave(sonority_array_21, 0, sa_21_max_octave_difference + 1);
+
+	SonorityArray sonority_array_12{ stripped_sonority_array, scratch }; // Voice 1 in the bass
+	int sa_12_max_octave_difference{ 0 };
+	for (const Sonority& sonority : sonority_array_12) {
+		const int octave_difference{ sonority.get_note_1().get_octave() - sonority.get_note_2().get_octave() };
+		if (octave_difference > sa_12_max_octave_difference) {
+			sa_12_max_octave_difference = octave_difference;
 		}
+	}
+	shift_voice_octave(sonority_array_12, 1, sa_12_max_octave_difference + 1);
 
-		const std::pair<std::vector<int>, std::vector<int>> default_dissonant_intervals{ std::vector<int>{1, 6}, std::vector<int>{} };
+	const std::vector<DissonantIntervals> dissonance_configurations{ default_dissonant_intervals, bass_dissonant_intervals };
+	SonorityMasks masks_21{ sonority_array_21, dissonance_configurations };
+	SonorityMasks masks_12{ sonority_array_12, dissonance_configurations };
 
-		std::vector<Message> sa_21_error_message_box{};
-		std::vector<Message> sa_21_warning_message_box{};
-		check_with_given_config(default_dissonant_intervals, sa_21_error_message_box, sa_21_warning_message_box, index_arrays_for_sonority_arrays, sonority_array_21, is_tick_dissonance_start, true, ticks_per_measure, key, rhythmic_hierarchy_array, rhythmic_hierarchy_max_depth, rhythmic_hierarchy_of_beat, voice_count);
-		const bool sa_21_valid{ sa_21_error_message_box.size() == 0 && sa_21_warning_message_box.size() <= settings.warning_threshold };
+	return Inversions{ std::move(index_arrays_for_sonority_arrays), std::move(sonority_array_21), std::move(sonority_array_12), std::move(masks_21), std::move(masks_12) };
+}
 
-		std::vector<Message> sa_12_error_message_box{};
-		std::vector<Message> sa_12_warning_message_box{};
-		check_with_given_config(default_dissonant_intervals, sa_12_error_message_box, sa_12_warning_message_box, index_arrays_for_sonority_arrays, sonority_array_12, is_tick_dissonance_start, false, ticks_per_measure, key, rhythmic_hierarchy_array, rhythmic_hierarchy_max_depth, rhythmic_hierarchy_of_beat, voice_count);
-		// write_to_is_tick_dissonance_start is false this time because whether a note is dissonant doesn't depend on voice order here
-		const bool sa_12_valid{ sa_12_error_message_box.size() == 0 && sa_12_warning_message_box.size() <= settings.warning_threshold };
+const VoicePairRoles check_roles(const Inversions& inversions, const VoicePairResult& result, DissonanceStarts& dissonance_starts, const int ticks_per_measure, const Key& key, const std::vector<int>& rhythmic_hierarchy_array, const int rhythmic_hierarchy_max_depth, const int rhythmic_hierarchy_of_beat, const std::size_t voice_count, const Settings& settings, std::pmr::memory_resource* scratch) {
+	// Check bass/top/outer voice pairs of the inversions check_voice_pair found valid. Only reads dissonance_starts
+	VoicePairRoles roles{};
+	MessageBoxes sa_2b1{ scratch }; // 2-bass, 1
+	MessageBoxes sa_21t{ scratch }; // 1 as top
+	MessageBoxes sa_2o1o{ scratch }; // Both are outer voices
+	if (result.sa_21_valid) {
+		check_with_given_config(bass_dissonant_intervals, sa_2b1.error_message_box, sa_2b1.warning_message_box, inversions.index_arrays_for_sonority_arrays, inversions.sonority_array_21, inversions.masks_21, dissonance_starts, false, ticks_per_measure, key, rhythmic_hierarchy_array, rhythmic_hierarchy_max_depth, rhythmic_hierarchy_of_beat, voice_count);
+	}
+	check_outer_voices(inversions.sonority_array_21, inversions.masks_21, inversions.index_arrays_for_sonority_arrays, result.sa_21_valid ? &sa_21t : nullptr, result.sa_21_valid ? &sa_2b1 : nullptr, &sa_2o1o, voice_count);
+	if (result.sa_21_valid) {
+		roles.invalid_bass_2 = sa_2b1.is_invalid(settings.warning_threshold);
+		roles.invalid_top_1 = sa_21t.is_invalid(settings.warning_threshold);
+	}
 
-		if (sa_21_valid && sa_12_valid) {
-			// canon.error_message_box() is empty by default
-			if (sa_21_warning_message_box.size() < sa_12_warning_message_box.size()) {
-				canon.warning_message_box() = sa_21_warning_message_box;
-			}
-			else {
-				canon.warning_message_box() = sa_12_warning_message_box;
-			}
-		}
-		else if (sa_21_valid) {
-			canon.warning_message_box() = sa_21_warning_message_box;
-			canon.add_non_invertible_voice_pair(voice_pair);
-		}
-		else if (sa_12_valid) {
-			canon.warning_message_box() = sa_12_warning_message_box;
-			canon.add_non_invertible_voice_pair(std::pair<int, int>{ voice_pair.second, voice_pair.first });
+	if (result.sa_12_valid) {
+		MessageBoxes sa_1b2{ scratch }; // 1-bass, 2
+		MessageBoxes sa_12t{ scratch }; // 2 as top
+		check_with_given_config(bass_dissonant_intervals, sa_1b2.error_message_box, sa_1b2.warning_message_box, inversions.index_arrays_for_sonority_arrays, inversions.sonority_array_12, inversions.masks_12, dissonance_starts, false, ticks_per_measure, key, rhythmic_hierarchy_array, rhythmic_hierarchy_max_depth, rhythmic_hierarchy_of_beat, voice_count);
+		check_outer_voices(inversions.sonority_array_12, inversions.masks_12, inversions.index_arrays_for_sonority_arrays, &sa_1b2, &sa_12t, nullptr, voice_count);
+		roles.invalid_bass_1 = sa_1b2.is_invalid(settings.warning_threshold);
+		roles.invalid_top_2 = sa_12t.is_invalid(settings.warning_threshold);
+	}
+
+	roles.invalid_outer_21 = sa_2o1o.is_invalid(settings.warning_threshold);
+	roles.invalid_outer_12 = roles.invalid_outer_21; // 1o2o has always been checked on sonority_array_21 too, so it's the same check
+
+	roles.dissonance_ticks_read = std::move(dissonance_starts.ticks_read());
+	return roles;
+}
+
+const VoicePairResult check_voice_pair(const CanonVoice& voice_1, const CanonVoice& voice_2, DissonanceStarts& dissonance_starts, const int ticks_per_measure, const Key& key, const std::vector<int>& rhythmic_hierarchy_array, const int rhythmic_hierarchy_max_depth, const int rhythmic_hierarchy_of_beat, const std::size_t voice_count, const Settings& settings, std::optional<VoicePairRoles>* roles) {
+	// Only decides which inversions are valid. Which roles they rule out is left to check_voice_roles, unless roles
+	// isn't nullptr: then a valid pair gets its roles checked here, on the same inversions and the marks it leaves
+	ScratchScope scratch_scope{}; // Everything below but the result is released in one go on return
+	std::pmr::memory_resource* const scratch{ scratch_scope.get_resource() };
+	const StageTimer timer{ Stage::check_voice_pair };
+	count_stat(StatCounter::voice_pair_checks);
+
+	VoicePairResult result{};
+	const Inversions inversions{ create_inversions(voice_1, voice_2, ticks_per_measure, rhythmic_hierarchy_array, rhythmic_hierarchy_max_depth, scratch) };
+
+	MessageBox sa_21_error_message_box{ scratch };
+	MessageBox sa_21_warning_message_box{ scratch };
+	check_with_given_config(default_dissonant_intervals, sa_21_error_message_box, sa_21_warning_message_box, inversions.index_arrays_for_sonority_arrays, inversions.sonority_array_21, inversions.masks_21, dissonance_starts, true, ticks_per_measure, key, rhythmic_hierarchy_array, rhythmic_hierarchy_max_depth, rhythmic_hierarchy_of_beat, voice_count);
+	result.sa_21_valid = sa_21_error_message_box.size() == 0 && sa_21_warning_message_box.size() <= settings.warning_threshold;
+
+	MessageBox sa_12_error_message_box{ scratch };
+	MessageBox sa_12_warning_message_box{ scratch };
+	check_with_given_config(default_dissonant_intervals, sa_12_error_message_box, sa_12_warning_message_box, inversions.index_arrays_for_sonority_arrays, inversions.sonority_array_12, inversions.masks_12, dissonance_starts, false, ticks_per_measure, key, rhythmic_hierarchy_array, rhythmic_hierarchy_max_depth, rhythmic_hierarchy_of_beat, voice_count);
+	// write_to_is_tick_dissonance_start is false this time because whether a note is dissonant doesn't depend on voice order here
+	result.sa_12_valid = sa_12_error_message_box.size() == 0 && sa_12_warning_message_box.size() <= settings.warning_threshold;
+
+	// The result outlives the scratch arena, so its boxes are copied out of it
+	if (result.sa_21_valid && result.sa_12_valid) {
+		if (sa_21_warning_message_box.size() < sa_12_warning_message_box.size()) {
+			result.warning_message_box.assign(sa_21_warning_message_box.begin(), sa_21_warning_message_box.end());
 		}
 		else {
-			// Doesn't matter which. One error disqualifies whole canon
-			canon.error_message_box() = sa_21_error_message_box;
+			result.warning_message_box.assign(sa_12_warning_message_box.begin(), sa_12_warning_message_box.end());
+		}
+	}
+	else if (result.sa_21_valid) {
+		result.warning_message_box.assign(sa_21_warning_message_box.begin(), sa_21_warning_message_box.end());
+	}
+	else if (result.sa_12_valid) {
+		result.warning_message_box.assign(sa_12_warning_message_box.begin(), sa_12_warning_message_box.end());
+	}
+	else {
+		// Doesn't matter which. One error disqualifies whole canon
+		result.error_message_box.assign(sa_21_error_message_box.begin(), sa_21_error_message_box.end());
 #ifdef DEBUG
-			std::cout << "Invalid\n";
+		std::cout << "Invalid\n";
 #endif // DEBUG
 
-			return;
-		}
+		return result;
+	}
 
-	// Check bass/top/outer voice pairs
-		bool sa_2b1_valid{ true };
-		bool sa_21t_valid{ true };
-		if (sa_21_valid) {
-		// 2 as bass
-			std::vector<Message> sa_2b1_error_message_box{}; // 2-bass, 1
-			std::vector<Message> sa_2b1_warning_message_box{};
-			check_with_given_config(std::pair<std::vector<int>, std::vector<int>>{ std::vector<int>{1, 3, 6}, std::vector<int>{ 6 } }, sa_2b1_error_message_box, sa_2b1_warning_message_box, index_arrays_for_sonority_arrays, sonority_array_21, is_tick_dissonance_start, false, ticks_per_measure, key, rhythmic_hierarchy_array, rhythmic_hierarchy_max_depth, rhythmic_hierarchy_of_beat, voice_count);
-			for (std::vector<int> index_array : index_arrays_for_sonority_arrays) {
-				if (index_array.size() > 0) {
-					check_outer_voice(sonority_array_21, index_array, 1, sa_2b1_error_message_box, sa_2b1_warning_message_box);
-				}
-			}
-			if (sa_2b1_error_message_box.size() > 0 || sa_2b1_warning_message_box.size() > settings.warning_threshold) {
-				canon.add_invalid_bass_voice(1); // Voice 2 is index 1
-				sa_2b1_valid = false;
-			}
+	if (roles != nullptr) {
+		const StageTimer roles_timer{ Stage::check_voice_roles };
+		count_stat(StatCounter::voice_role_checks);
+		DissonanceStarts role_dissonance_starts{ dissonance_starts.marks() };
+		roles->emplace(check_roles(inversions, result, role_dissonance_starts, ticks_per_measure, key, rhythmic_hierarchy_array, rhythmic_hierarchy_max_depth, rhythmic_hierarchy_of_beat, voice_count, settings, scratch));
+	}
 
-		// 1 as top
-			std::vector<Message> sa_21t_error_message_box{}; // 2-bass, 1
-			std::vector<Message> sa_21t_warning_message_box{};
-			for (std::vector<int> index_array : index_arrays_for_sonority_arrays) {
-				if (index_array.size() > 0) {
-					check_outer_voice(sonority_array_21, index_array, 0, sa_21t_error_message_box, sa_21t_warning_message_box);
-				}
-			}
-			if (sa_21t_error_message_box.size() > 0 || sa_21t_warning_message_box.size() > settings.warning_threshold) {
-				canon.add_invalid_top_voice(0);
-				sa_21t_valid = false;
+	return result;
+}
+
+const VoicePairRoles check_voice_roles(const CanonVoice& voice_1, const CanonVoice& voice_2, const VoicePairResult& result, DissonanceStarts& dissonance_starts, const int ticks_per_measure, const Key& key, const std::vector<int>& rhythmic_hierarchy_array, const int rhythmic_hierarchy_max_depth, const int rhythmic_hierarchy_of_beat, const std::size_t voice_count, const Settings& settings) {
+	ScratchScope scratch_scope{};
+	std::pmr::memory_resource* const scratch{ scratch_scope.get_resource() };
+	const StageTimer timer{ Stage::check_voice_roles };
+	count_stat(StatCounter::voice_role_checks);
+	const Inversions inversions{ create_inversions(voice_1, voice_2, ticks_per_measure, rhythmic_hierarchy_array, rhythmic_hierarchy_max_depth, scratch) };
+	return check_roles(inversions, result, dissonance_starts, ticks_per_measure, key, rhythmic_hierarchy_array, rhythmic_hierarchy_max_depth, rhythmic_hierarchy_of_beat, voice_count, settings, scratch);
+}
+
+const bool apply_voice_pair_result(Canon& canon, const std::pair<int, int>& voice_pair, const VoicePairResult& result) {
+	// Returns false if the pair disqualifies the canon
+	if (result.sa_21_valid && result.sa_12_valid) {
+		// canon.error_message_box() is empty by default
+		canon.warning_message_box() = result.warning_message_box;
+	}
+	else if (result.sa_21_valid) {
+		canon.warning_message_box() = result.warning_message_box;
+		canon.add_non_invertible_voice_pair(voice_pair);
+	}
+	else if (result.sa_12_valid) {
+		canon.warning_message_box() = result.warning_message_box;
+		canon.add_non_invertible_voice_pair(std::pair<int, int>{ voice_pair.second, voice_pair.first });
+	}
+	else {
+		canon.error_message_box() = result.error_message_box;
+		return false;
+	}
+
+	return true;
+}
+
+void apply_voice_pair_roles(Canon& canon, const std::pair<int, int>& voice_pair, const VoicePairRoles& roles) {
+	if (roles.invalid_bass_2) {
+		canon.add_invalid_bass_voice(1); // Voice 2 is index 1
+	}
+	if (roles.invalid_top_1) {
+		canon.add_invalid_top_voice(0);
+	}
+	if (roles.invalid_bass_1) {
+		canon.add_invalid_bass_voice(0);
+	}
+	if (roles.invalid_top_2) {
+		canon.add_invalid_top_voice(1);
+	}
+	if (roles.invalid_outer_21) {
+		canon.add_invalid_outer_voice_pair(std::pair<int, int>{ voice_pair.second, voice_pair.first });
+	}
+	if (roles.invalid_outer_12) {
+		canon.add_invalid_outer_voice_pair(voice_pair);
+	}
+}
+
+const int get_length_ticks(const CanonVoice& voice) {
+	int ticks{ voice.get_padding_measures() * voice.get_padding_rest().get_duration_ticks() };
+	for (const CompactNote& note : voice.get_notes()) {
+		ticks += note.get_duration_ticks();
+	}
+	return ticks;
+}
+
+const bool is_voice_pair_viable(const CanonVoice& voice_1, const Shift& shift_1, const CanonVoice& voice_2, const Shift& shift_2, const std::size_t voice_count, const int ticks_per_measure, const Key& key, const std::vector<int>& rhythmic_hierarchy_array, const int rhythmic_hierarchy_max_depth, const int rhythmic_hierarchy_of_beat, const Settings& settings, PairCache& pair_cache) {
+	// Checks one pair as if it were the first pair of the canon, i.e. with no dissonances marked by other pairs.
+	// Marks from other pairs only ever take inversions away, so a pair that fails here fails in every canon.
+	// The result lands in the cache, so check_counterpoint mostly reuses it
+	const VoicePairKey key_for_pair{ make_voice_pair_key(shift_1, shift_2, voice_count) };
+	if (const VoicePairResult* cached_result{ pair_cache.find(key_for_pair) }; cached_result != nullptr) {
+		return cached_result->sa_21_valid || cached_result->sa_12_valid;
+	}
+
+	ScratchScope scratch_scope{};
+	std::pmr::vector<bool> is_tick_dissonance_start(std::max(get_length_ticks(voice_1), get_length_ticks(voice_2)), false, scratch_scope.get_resource());
+	DissonanceStarts dissonance_starts{ is_tick_dissonance_start };
+	VoicePairResult result{ check_voice_pair(voice_1, voice_2, dissonance_starts, ticks_per_measure, key, rhythmic_hierarchy_array, rhythmic_hierarchy_max_depth, rhythmic_hierarchy_of_beat, voice_count, settings, nullptr) };
+	result.dissonance_ticks_read = std::move(dissonance_starts.ticks_read());
+	result.dissonance_ticks_written = std::move(dissonance_starts.ticks_written());
+	pair_cache.insert(key_for_pair, result);
+
+	return result.sa_21_valid || result.sa_12_valid;
+}
+
+const bool are_new_voice_pairs_viable(Canon& canon, const int ticks_per_measure, const Key& key, const std::vector<int>& rhythmic_hierarchy_array, const int rhythmic_hierarchy_max_depth, const int rhythmic_hierarchy_of_beat, const Settings& settings, PairCache& pair_cache) {
+	// Checks every pair containing the newest voice on its own (see is_voice_pair_viable)
+	const std::size_t voice_count{ canon.texture().size() };
+	const int new_voice{ static_cast<int>(voice_count) - 1 };
+
+	for (int voice{ 0 }; voice < new_voice; ++voice) {
+		const VoicePairResult* cached_result{ pair_cache.find(make_voice_pair_key(canon.get_shifts().at(voice), canon.get_shifts().at(new_voice), voice_count)) };
+		if (cached_result != nullptr) {
+			if (!cached_result->sa_21_valid && !cached_result->sa_12_valid) {
+				return false;
 			}
+			continue;
 		}
-		else {
-			sa_2b1_valid = false;
-			sa_21t_valid = false;
+
+		if (!is_voice_pair_viable(canon.texture().at(voice), canon.get_shifts().at(voice), canon.texture().at(new_voice), canon.get_shifts().at(new_voice), voice_count, ticks_per_measure, key, rhythmic_hierarchy_array, rhythmic_hierarchy_max_depth, rhythmic_hierarchy_of_beat, settings, pair_cache)) {
+			return false;
 		}
+	}
 
-		bool sa_1b2_valid{ true };
-		bool sa_12t_valid{ true };
-		if (sa_12_valid) {
-			// 1 as bass
-			std::vector<Message> sa_1b2_error_message_box{};
-			std::vector<Message> sa_1b2_warning_message_box{};
-			check_with_given_config(std::pair<std::vector<int>, std::vector<int>>{ std::vector<int>{1, 3, 6}, std::vector<int>{ 6 } }, sa_1b2_error_message_box, sa_1b2_warning_message_box, index_arrays_for_sonority_arrays, sonority_array_12, is_tick_dissonance_start, false, ticks_per_measure, key, rhythmic_hierarchy_array, rhythmic_hierarchy_max_depth, rhythmic_hierarchy_of_beat, voice_count);
-			for (std::vector<int> index_array : index_arrays_for_sonority_arrays) {
-				if (index_array.size() > 0) {
-					check_outer_voice(sonority_array_12, index_array, 0, sa_1b2_error_message_box, sa_1b2_warning_message_box);
-				}
-			}
-			if (sa_1b2_error_message_box.size() > 0 || sa_1b2_warning_message_box.size() > settings.warning_threshold) {
-				canon.add_invalid_bass_voice(0);
-				sa_1b2_valid = false;
-			}
+	return true;
+}
 
-			// 2 as top
-			std::vector<Message> sa_12t_error_message_box{};
-			std::vector<Message> sa_12t_warning_message_box{};
-			for (std::vector<int> index_array : index_arrays_for_sonority_arrays) {
-				if (index_array.size() > 0) {
-					check_outer_voice(sonority_array_12, index_array, 1, sa_12t_error_message_box, sa_12t_warning_message_box);
-				}
-			}
-			if (sa_12t_error_message_box.size() > 0 || sa_12t_warning_message_box.size() > settings.warning_threshold) {
-				canon.add_invalid_top_voice(1);
-				sa_12t_valid = false;
-			}
+const bool check_counterpoint(Canon& canon, const int ticks_per_measure, const Key& key, const std::vector<int>& rhythmic_hierarchy_array, const int rhythmic_hierarchy_max_depth, const int rhythmic_hierarchy_of_beat, const Settings& settings, PairCache& pair_cache) {
+	// NOTE: Only use higher rhythmic levels to check for PARALLELS
+	// This doesn't care about whether which voice is the bass. It assumes the composer can add another bass voice
+	// Return type is a pair of lists of error and warning messages
+	ScratchScope scratch_scope{};
+	std::pmr::memory_resource* const scratch{ scratch_scope.get_resource() };
+	const StageTimer timer{ Stage::check_counterpoint };
+	const std::size_t voice_count{ canon.texture().size() };
+
+	// Get every unordered combination of two voices
+	std::pmr::vector<std::pair<int, int>> voice_pairs{ scratch };
+	for (int i{ 0 }; i < voice_count; ++i) {
+		for (int j{ i + 1 }; j < voice_count; ++j) {
+			voice_pairs.emplace_back(std::pair<int, int>{i, j});
 		}
-		else {
-			sa_1b2_valid = false;
-			sa_12t_valid = false;
+	}
+
+	// Fail fast: a cached pair that failed on its own fails in every canon (see is_voice_pair_viable), so look up
+	// every pair before checking any of them, starting with the pairs that have rejected the most canons so far.
+	// Uncached pairs are left to the loop below, since their verdict there can depend on the pairs before them
+	std::pmr::vector<std::pair<int, int>> fail_fast_order{ voice_pairs, scratch };
+	pair_cache.rejection_counts().sort_by_rejections(fail_fast_order);
+	for (const std::pair<int, int>& voice_pair : fail_fast_order) {
+		const VoicePairResult* cached_result{ pair_cache.find(make_voice_pair_key(canon.get_shifts().at(voice_pair.first), canon.get_shifts().at(voice_pair.second), voice_count)) };
+		if (cached_result != nullptr && !cached_result->sa_21_valid && !cached_result->sa_12_valid) {
+			pair_cache.rejection_counts().record(voice_pair);
+			count_stat(StatCounter::fail_fast_rejections);
+			apply_voice_pair_result(canon, voice_pair, *cached_result);
+			return false;
 		}
-		
-	// Both are outer voices
-		//if (!sa_2b1_valid || !sa_21t_valid)	{
-		//	canon.add_invalid_outer_voice_pair(std::pair<int, int>{ voice_pair.second, voice_pair.first });
-		//}
-		//else {
-			// 2o1o
-			std::vector<Message> sa_2o1o_error_message_box{};
-			std::vector<Message> sa_2o1o_warning_message_box{};
-			for (std::vector<int> index_array : index_arrays_for_sonority_arrays) {
-				if (index_array.size() > 0) {
-					check_outer_voice_pair(sonority_array_21, index_array, sa_2o1o_error_message_box, sa_2o1o_warning_message_box, voice_count);
-				}
-			}
-			if (sa_2o1o_error_message_box.size() > 0 || sa_2o1o_warning_message_box.size() > settings.warning_threshold) {
-				canon.add_invalid_outer_voice_pair(std::pair<int, int>{ voice_pair.second, voice_pair.first });
+	}
+
+	// Start ticks of all dissonances
+	std::pmr::vector<bool> is_tick_dissonance_start(get_length_ticks(canon.texture().at(0)), false, scratch);
+
+	// The verdict of every pair, in voice_pairs order. Results the cache won't take are kept here
+	std::pmr::vector<const VoicePairResult*> pair_results{ scratch };
+	std::pmr::vector<VoicePairResult> uncached_results{ scratch };
+	uncached_results.reserve(voice_pairs.size()); // Never reallocates, so pair_results can point into it
+	// Once the last pair is valid, so is the canon, so the last pair's roles are checked along with its verdict
+	std::optional<VoicePairRoles> last_pair_roles{};
+
+	// FOR EACH PAIR OF VOICES {
+	for (const std::pair<int, int>& voice_pair : voice_pairs) {
+		const VoicePairKey key_for_pair{ make_voice_pair_key(canon.get_shifts().at(voice_pair.first), canon.get_shifts().at(voice_pair.second), voice_count) };
+
+		const VoicePairResult* cached_result{ pair_cache.find(key_for_pair) };
+		if (cached_result != nullptr
+			&& std::none_of(cached_result->dissonance_ticks_read.begin(), cached_result->dissonance_ticks_read.end(), [&](const int tick) { return is_tick_dissonance_start.at(tick); }))
+			// Reuse only if no earlier pair marked a dissonance where this pair looked
+		{
+			count_stat(StatCounter::pair_cache_hits);
+			for (const int tick : cached_result->dissonance_ticks_written) {
+				is_tick_dissonance_start.at(tick) = true;
 			}
-		//}
-
-		//if (!sa_1b2_valid || !sa_12t_valid) {
-		//	canon.add_invalid_outer_voice_pair(voice_pair);
-		//}
-		//else {
-			// 1o2o
-			std::vector<Message> sa_1o2o_error_message_box{};
-			std::vector<Message> sa_1o2o_warning_message_box{};
-			for (std::vector<int> index_array : index_arrays_for_sonority_arrays) {
-				if (index_array.size() > 0) {
-					check_outer_voice_pair(sonority_array_21, index_array, sa_1o2o_error_message_box, sa_1o2o_warning_message_box, voice_count);
-				}
+			if (!apply_voice_pair_result(canon, voice_pair, *cached_result)) {
+				pair_cache.rejection_counts().record(voice_pair);
+				return false;
 			}
+			pair_results.emplace_back(cached_result);
+			continue;
+		}
+
+		DissonanceStarts dissonance_starts{ is_tick_dissonance_start };
+		const bool is_last_pair{ &voice_pair == &voice_pairs.back() };
+		VoicePairResult result{ check_voice_pair(canon.texture().at(voice_pair.first), canon.texture().at(voice_pair.second), dissonance_starts, ticks_per_measure, key, rhythmic_hierarchy_array, rhythmic_hierarchy_max_depth, rhythmic_hierarchy_of_beat, voice_count, settings, is_last_pair ? &last_pair_roles : nullptr) };
+		const bool is_cacheable{ dissonance_starts.read_only_own_marks() };
+		result.dissonance_ticks_read = std::move(dissonance_starts.ticks_read());
+		result.dissonance_ticks_written = std::move(dissonance_starts.ticks_written());
 
-			if (sa_1o2o_error_message_box.size() > 0 || sa_1o2o_warning_message_box.size() > settings.warning_threshold) {
-				canon.add_invalid_outer_voice_pair(voice_pair);
+		if (!apply_voice_pair_result(canon, voice_pair, result)) {
+			if (is_cacheable) {
+				pair_cache.insert(key_for_pair, result);
 			}
-		//}
+			pair_cache.rejection_counts().record(voice_pair);
+			return false;
+		}
+		pair_results.emplace_back(is_cacheable ? pair_cache.insert(key_for_pair, result) : &uncached_results.emplace_back(std::move(result)));
 
 #ifdef DEBUG
 			//print_messages(canon);
 #endif // DEBUG
 			//print_results(canon, settings);
 	}
-}
\ No newline at end of file
+
+	// Every pair has a valid inversion, so only now work out which roles each pair rules out. Each pair sees the
+	// same dissonances as above: the ones of the pairs before it and its own
+	std::fill(is_tick_dissonance_start.begin(), is_tick_dissonance_start.end(), false);
+	const auto is_unmarked{ [&](const std::vector<int>& ticks) {
+		return std::none_of(ticks.begin(), ticks.end(), [&](const int tick) { return is_tick_dissonance_start.at(tick); });
+	} };
+	for (std::size_t pair_index{ 0 }; pair_index < voice_pairs.size(); ++pair_index) {
+		const std::pair<int, int>& voice_pair{ voice_pairs.at(pair_index) };
+		const VoicePairResult& result{ *pair_results.at(pair_index) };
+		const VoicePairKey key_for_pair{ make_voice_pair_key(canon.get_shifts().at(voice_pair.first), canon.get_shifts().at(voice_pair.second), voice_count) };
+
+		// If no earlier pair marked a tick the verdict looked at, it's the verdict every canon with this pair gets
+		// when it's unmarked there, so the roles can be reused and cached on the same terms
+		const bool is_result_reusable{ is_unmarked(result.dissonance_ticks_read) };
+		const VoicePairRoles* cached_roles{ is_result_reusable ? pair_cache.find_roles(key_for_pair) : nullptr };
+		const bool is_cached_roles_reusable{ cached_roles != nullptr && is_unmarked(cached_roles->dissonance_ticks_read) };
+
+		for (const int tick : result.dissonance_ticks_written) {
+			is_tick_dissonance_start.at(tick) = true;
+		}
+
+		if (is_cached_roles_reusable) {
+			count_stat(StatCounter::role_cache_hits);
+			apply_voice_pair_roles(canon, voice_pair, *cached_roles);
+			continue;
+		}
+
+		VoicePairRoles roles{};
+		if (pair_index + 1 == voice_pairs.size() && last_pair_roles.has_value()) {
+			roles = std::move(*last_pair_roles); // Checked against these same marks
+		}
+		else {
+			DissonanceStarts dissonance_starts{ is_tick_dissonance_start };
+			roles = check_voice_roles(canon.texture().at(voice_pair.first), canon.texture().at(voice_pair.second), result, dissonance_starts, ticks_per_measure, key, rhythmic_hierarchy_array, rhythmic_hierarchy_max_depth, rhythmic_hierarchy_of_beat, voice_count, settings);
+		}
+		if (is_result_reusable
+			&& std::all_of(roles.dissonance_ticks_read.begin(), roles.dissonance_ticks_read.end(), [&](const int tick) {
+				return !is_tick_dissonance_start.at(tick) || std::find(result.dissonance_ticks_written.begin(), result.dissonance_ticks_written.end(), tick) != result.dissonance_ticks_written.end();
+			}))
+			// Only this pair marked the ticks the roles looked at
+		{
+			pair_cache.insert_roles(key_for_pair, roles);
+		}
+		apply_voice_pair_roles(canon, voice_pair, roles);
+	}
+
+	return true;
+}
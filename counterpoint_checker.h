@@ -2,6 +2,7 @@
 
 #include "sonority.h"
 #include "canon.h"
+#include "pair_cache.h"
 
 #include "mx/api/ScoreData.h"
 
@@ -19,4 +20,6 @@ struct Key {
 	const ScaleDegree leading_tone{};
 };
 
-void check_counterpoint(Canon& canon, const int ticks_per_measure, const Key& key, const std::vector<int>& rhythmic_hierarchy_array, const int rhythmic_hierarchy_max_depth, const int rhythmic_hierarchy_of_beat, const Settings& settings);
+const bool check_counterpoint(Canon& canon, const int ticks_per_measure, const Key& key, const std::vector<int>& rhythmic_hierarchy_array, const int rhythmic_hierarchy_max_depth, const int rhythmic_hierarchy_of_beat, const Settings& settings, PairCache& pair_cache); // False if a pair of voices has no valid inversion
+const int get_length_ticks(const CanonVoice& voice);
+const bool are_new_voice_pairs_viable(Canon& canon, const int ticks_per_measure, const Key& key, const std::vector<int>& rhythmic_hierarchy_array, const int rhythmic_hierarchy_max_depth, const int rhythmic_hierarchy_of_beat, const Settings& settings, PairCache& pair_cache); // Cheap rejection before check_counterpoint
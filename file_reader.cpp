@@ -1,19 +1,34 @@
+#include "file_reader.h"
 #include "exception.h"
 #include "settings.h"
+#include "compact_note.h"
 #include "mx/api/DocumentManager.h"
 #include "mx/api/ScoreData.h"
 #include "mx/api/TransposeData.h"
+#include "private/pugixml.hpp"
 
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <fstream>
 #include <filesystem>
 #include <cstdint>
+#include <cstdlib>
+#include <cmath>
+#include <optional>
 #include <sstream>
+#include <string_view>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 const std::string read_file(const std::string& path) { // const
-	// ifstream is used for reading files
-    std::ifstream file{ path };
+	// Binary so the size from file_size() is exactly what read() gets
+    std::ifstream file{ path, std::ios::binary };
 
 	// If we couldn't open the output file stream for reading
 	if (!file) {
@@ -22,19 +37,76 @@ const std::string read_file(const std::string& path) { // const
 	}
 
 	// Read file contents to variable https://stackoverflow.com/questions/2602013/read-whole-ascii-file-into-c-stdstring
-	auto size = std::filesystem::file_size(path);
+	const auto size{ std::filesystem::file_size(path) };
 	std::string file_contents(size, '\0');
-	std::ifstream in(path);
-	in.read(&file_contents[0], size);
-
-    //std::cout << file_contents;
+	file.read(file_contents.data(), size);
 
 	return file_contents;
 
-	// When inf goes out of scope, the ifstream
+	// When file goes out of scope, the ifstream
 	// destructor will close the file
 }
 
+// A file's contents as one writable buffer for pugixml's in-place parser. On POSIX this is a private (copy on
+// write) mapping, so only the pages the parser writes to get copied and the file itself is never touched.
+// Elsewhere the file is read into a buffer once
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+#ifndef _WIN32
+        const int descriptor{ open(path.c_str(), O_RDONLY) };
+        if (descriptor < 0) {
+            throw Exception("Can't read file \"" + path + "\"!\n");
+        }
+
+        struct stat status {};
+        if (fstat(descriptor, &status) != 0 || status.st_size <= 0) {
+            close(descriptor);
+            throw Exception("Can't read file \"" + path + "\" (empty or unreadable)!\n");
+        }
+
+        m_size = static_cast<std::size_t>(status.st_size);
+        void* mapping{ mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, descriptor, 0) };
+        close(descriptor); // The mapping keeps its own reference to the file
+        if (mapping == MAP_FAILED) {
+            throw Exception("Can't map file \"" + path + "\"!\n");
+        }
+        m_data = mapping;
+#else
+        m_buffer = read_file(path);
+        if (m_buffer.empty()) {
+            throw Exception("Can't read file \"" + path + "\" (empty)!\n");
+        }
+        m_data = m_buffer.data();
+        m_size = m_buffer.size();
+#endif
+    }
+
+    ~MappedFile() {
+#ifndef _WIN32
+        munmap(m_data, m_size);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    void* get_data() const {
+        return m_data;
+    }
+
+    const std::size_t size() const {
+        return m_size;
+    }
+
+private:
+    void* m_data{ nullptr };
+    std::size_t m_size{ 0 };
+#ifdef _WIN32
+    std::string m_buffer{};
+#endif
+};
+
 const bool is_measure_empty(const mx::api::VoiceData voice) {
     for (const mx::api::NoteData& note : voice.notes) {
         if (!note.isRest) {
@@ -45,22 +117,7 @@ const bool is_measure_empty(const mx::api::VoiceData voice) {
     return true;
 }
 
-const mx::api::ScoreData get_score_object(const std::string& xml) {
-    // create a reference to the singleton which holds documents in memory for us
-    auto& mgr = mx::api::DocumentManager::getInstance();
-
-    // place the xml from above into a stream object
-    std::istringstream istr{ xml };
-
-    // ask the document manager to parse the xml into memory for us, returns a document ID.
-    const auto documentID = mgr.createFromStream(istr);
-
-    // get the structural representation of the score from the document manager
-    auto score = mgr.getData(documentID);
-
-    // we need to explicitly destroy the document from memory
-    mgr.destroyDocument(documentID);
-
+void trim_empty_measures(mx::api::ScoreData& score) {
     auto& score_measures { score.parts.at(0).measures };
 
     // delete empty starting measures
@@ -86,10 +143,40 @@ const mx::api::ScoreData get_score_object(const std::string& xml) {
             break;
         }
     }
+}
+
+const mx::api::ScoreData parse_score_buffer(void* data, const std::size_t size) {
+    // create a reference to the singleton which holds documents in memory for us
+    auto& mgr = mx::api::DocumentManager::getInstance();
+
+    // ask the document manager to parse the xml in place, returns a document ID.
+    const auto documentID = mgr.createFromBuffer(data, size);
+
+    // get the structural representation of the score from the document manager
+    auto score = mgr.getData(documentID);
 
+    // we need to explicitly destroy the document from memory
+    mgr.destroyDocument(documentID);
+
+    trim_empty_measures(score);
     return score;
 }
 
+const mx::api::ScoreData get_score_object(const std::string& xml) {
+    // The parser writes into its buffer, so it gets one copy of the xml (it used to be copied into a stream
+    // and then again into pugixml's own buffer)
+    std::string buffer{ xml };
+    if (buffer.empty()) {
+        throw Exception("Empty MusicXML input!");
+    }
+    return parse_score_buffer(buffer.data(), buffer.size());
+}
+
+const mx::api::ScoreData read_score_file(const std::string& path) {
+    const MappedFile file{ path };
+    return parse_score_buffer(file.get_data(), file.size());
+}
+
 const std::vector<mx::api::NoteData> create_voice_array(const mx::api::ScoreData& score) {
     if (score.parts.size() != 1)
     {
@@ -128,4 +215,264 @@ const std::vector<mx::api::NoteData> create_voice_array(const mx::api::ScoreData
     }
 
     return part_condensed; // WORK ON THIS
-}
\ No newline at end of file
+}
+
+const SubjectData get_subject(const mx::api::ScoreData& score) {
+    const mx::api::MeasureData& first_measure{ score.parts.at(0).measures.at(0) };
+    const mx::api::NoteData& last_note{ first_measure.staves.at(0).voices.at(0).notes.back() };
+    return SubjectData{
+        compact_voice(create_voice_array(score)),
+        (first_measure.keys.size() > 0) ? first_measure.keys.at(0).fifths : 0,
+        first_measure.timeSignature,
+        last_note.tickTimePosition + last_note.durationData.durationTimeTicks,
+        static_cast<int>(score.parts.at(0).measures.size()),
+    };
+}
+
+const std::optional<int> parse_integer(const char* text) {
+    char* end{};
+    const long value{ std::strtol(text, &end, 10) };
+    if (end == text || *end != '\0') {
+        return std::nullopt;
+    }
+    return static_cast<int>(value);
+}
+
+const std::optional<long double> parse_decimal(const char* text) {
+    char* end{};
+    const long double value{ std::strtold(text, &end) };
+    if (end == text || *end != '\0') {
+        return std::nullopt;
+    }
+    return value;
+}
+
+const std::optional<mx::api::Step> parse_step(const std::string_view text) {
+    static constexpr std::string_view steps{ "CDEFGAB" };
+    if (text.size() != 1 || steps.find(text.front()) == std::string_view::npos) {
+        return std::nullopt;
+    }
+    return static_cast<mx::api::Step>(steps.find(text.front()));
+}
+
+const std::optional<mx::api::Accidental> parse_accidental(const std::string_view text) {
+    // The common ones. Anything else goes through mx
+    if (text == "sharp") {
+        return mx::api::Accidental::sharp;
+    }
+    else if (text == "natural") {
+        return mx::api::Accidental::natural;
+    }
+    else if (text == "flat") {
+        return mx::api::Accidental::flat;
+    }
+    else if (text == "double-sharp") {
+        return mx::api::Accidental::doubleSharp;
+    }
+    else if (text == "flat-flat") {
+        return mx::api::Accidental::flatFlat;
+    }
+    return std::nullopt;
+}
+
+const std::optional<CompactNote> read_note(const pugi::xml_node& note) {
+    // Same NoteData fields as mx's NoteReader fills in, for the ones CompactNote keeps. Durations are still in
+    // divisions, which are the ticks mx uses as long as divisions never change
+    if (note.child("chord") || note.child("grace") || note.child("cue") || note.child("unpitched")) {
+        return std::nullopt;
+    }
+    if (const pugi::xml_node staff{ note.child("staff") }; staff && parse_integer(staff.child_value()) != 1) {
+        return std::nullopt;
+    }
+
+    const std::optional<long double> duration{ parse_decimal(note.child_value("duration")) };
+    if (!duration || *duration < 0) {
+        return std::nullopt;
+    }
+
+    mx::api::NoteData data{};
+    data.durationData.durationTimeTicks = static_cast<int>(std::ceil(*duration - 0.5L));
+
+    if (const pugi::xml_node rest{ note.child("rest") }) {
+        data.isRest = true;
+        if (rest.child("display-step")) {
+            const std::optional<mx::api::Step> step{ parse_step(rest.child_value("display-step")) };
+            const std::optional<int> octave{ parse_integer(rest.child_value("display-octave")) };
+            if (!step || !octave) {
+                return std::nullopt;
+            }
+            data.pitchData.step = *step;
+            data.pitchData.octave = *octave;
+        }
+    }
+    else {
+        const pugi::xml_node pitch{ note.child("pitch") };
+        const std::optional<mx::api::Step> step{ parse_step(pitch.child_value("step")) };
+        const std::optional<int> octave{ parse_integer(pitch.child_value("octave")) };
+        if (!step || !octave) {
+            return std::nullopt;
+        }
+        data.pitchData.step = *step;
+        data.pitchData.octave = *octave;
+
+        if (pitch.child("alter")) {
+            const std::optional<long double> alter{ parse_decimal(pitch.child_value("alter")) };
+            if (!alter || *alter != std::floor(*alter)) {
+                return std::nullopt; // Microtones
+            }
+            data.pitchData.alter = static_cast<int>(*alter);
+        }
+
+        if (const pugi::xml_node accidental{ note.child("accidental") }) {
+            const std::optional<mx::api::Accidental> value{ parse_accidental(accidental.child_value()) };
+            if (!value) {
+                return std::nullopt;
+            }
+            data.pitchData.accidental = *value;
+            data.pitchData.isAccidentalParenthetical = std::string_view{ accidental.attribute("parentheses").value() } == "yes";
+            data.pitchData.isAccidentalCautionary = std::string_view{ accidental.attribute("cautionary").value() } == "yes";
+            data.pitchData.isAccidentalEditorial = std::string_view{ accidental.attribute("editorial").value() } == "yes";
+            data.pitchData.isAccidentalBracketed = std::string_view{ accidental.attribute("bracket").value() } == "yes";
+        }
+    }
+
+    for (const pugi::xml_node& tie : note.children("tie")) {
+        const std::string_view type{ tie.attribute("type").value() };
+        data.isTieStart = data.isTieStart || type == "start";
+        data.isTieStop = data.isTieStop || type == "stop";
+    }
+
+    return CompactNote{ data };
+}
+
+const std::optional<SubjectData> read_subject(const pugi::xml_document& document) {
+    // One walk over the first part. Gives up (nullopt) on anything where the result could differ from
+    // get_subject(get_score_object(xml)), which then does the work
+    const pugi::xml_node root{ document.child("score-partwise") };
+    const pugi::xml_node part{ root.child("part") };
+    if (!part || part.next_sibling("part")) {
+        return std::nullopt;
+    }
+
+    std::vector<CompactVoice> measures{};
+    int divisions{ 0 };
+    std::optional<int> fifths{};
+    std::optional<mx::api::TimeSignatureData> time_signature{};
+    for (const pugi::xml_node& measure : part.children("measure")) {
+        const bool is_first_measure{ measures.empty() };
+        CompactVoice notes{};
+        for (const pugi::xml_node& element : measure.children()) {
+            const std::string_view name{ element.name() };
+            if (name == "note") {
+                const std::optional<CompactNote> note{ (divisions > 0) ? read_note(element) : std::nullopt };
+                if (!note) {
+                    return std::nullopt;
+                }
+                notes.emplace_back(*note);
+            }
+            else if (name == "backup" || name == "forward") {
+                return std::nullopt; // More than one voice
+            }
+            else if (name == "attributes") {
+                if (const pugi::xml_node staves{ element.child("staves") }; staves && parse_integer(staves.child_value()) != 1) {
+                    return std::nullopt;
+                }
+                if (element.child("divisions")) {
+                    // mx rescales everything to the least common multiple of the divisions. Leave that to mx
+                    const std::optional<long double> value{ parse_decimal(element.child_value("divisions")) };
+                    if (!value || *value <= 0 || (divisions > 0 && static_cast<int>(std::ceil(*value - 0.5L)) != divisions)) {
+                        return std::nullopt;
+                    }
+                    divisions = static_cast<int>(std::ceil(*value - 0.5L));
+                }
+                if (const pugi::xml_node key{ element.child("key") }; is_first_measure && key && !fifths) {
+                    fifths = parse_integer(key.child_value("fifths"));
+                    if (!fifths) {
+                        return std::nullopt; // Non-traditional key
+                    }
+                }
+                if (const pugi::xml_node time{ element.child("time") }; is_first_measure && time) {
+                    const std::optional<int> beats{ parse_integer(time.child_value("beats")) };
+                    const std::optional<int> beat_type{ parse_integer(time.child_value("beat-type")) };
+                    if (time_signature || !beats || !beat_type || time.child("beats").next_sibling("beats")) {
+                        return std::nullopt; // Composite, senza-misura or more than one time signature
+                    }
+                    time_signature = mx::api::TimeSignatureData{};
+                    time_signature->beats = *beats;
+                    time_signature->beatType = *beat_type;
+                }
+            }
+        }
+
+        if (notes.empty()) {
+            return std::nullopt;
+        }
+        measures.emplace_back(std::move(notes));
+    }
+
+    // Same trimming as get_score_object()
+    const auto is_empty{ [](const CompactVoice& notes) {
+        return std::all_of(notes.begin(), notes.end(), [](const CompactNote& note) { return note.is_rest(); });
+    } };
+    const auto first{ std::find_if_not(measures.begin(), measures.end(), is_empty) };
+    const auto last{ std::find_if_not(measures.rbegin(), measures.rend(), is_empty).base() };
+    if (first == measures.end()) {
+        return std::nullopt;
+    }
+
+    SubjectData subject{};
+    for (auto measure{ first }; measure != last; ++measure) {
+        subject.leader.insert(subject.leader.end(), measure->begin(), measure->end());
+    }
+    for (const CompactNote& note : *first) {
+        subject.ticks_per_measure += note.get_duration_ticks();
+    }
+    subject.fifths = fifths.value_or(0);
+    subject.time_signature = time_signature.value_or(mx::api::TimeSignatureData{});
+    subject.measure_count = static_cast<int>(last - first);
+    return subject;
+}
+
+InputScore::InputScore(const SubjectData& subject, const std::function<const mx::api::ScoreData()>& read_score)
+    : m_subject{ subject }, m_read_score{ read_score } {
+}
+
+InputScore::InputScore(const mx::api::ScoreData& score)
+    : m_subject{ ::get_subject(score) }, m_score{ score } {
+}
+
+const mx::api::ScoreData& InputScore::get_score() const {
+    if (!m_score) {
+        m_score = m_read_score();
+    }
+    return *m_score;
+}
+
+InputScore read_input_file(const std::string& path) {
+    std::optional<SubjectData> subject{};
+    {
+        const MappedFile file{ path };
+        pugi::xml_document document{};
+        if (document.load_buffer_inplace(file.get_data(), file.size(), pugi::parse_minimal)) {
+            subject = read_subject(document);
+        }
+    }
+
+    if (!subject) {
+        return InputScore{ read_score_file(path) };
+    }
+    return InputScore{ *subject, [path]() { return read_score_file(path); } };
+}
+
+InputScore read_input_string(const std::string& xml) {
+    std::optional<SubjectData> subject{};
+    pugi::xml_document document{};
+    if (document.load_buffer(xml.data(), xml.size(), pugi::parse_minimal)) {
+        subject = read_subject(document);
+    }
+
+    if (!subject) {
+        return InputScore{ get_score_object(xml) };
+    }
+    return InputScore{ *subject, [xml]() { return get_score_object(xml); } };
+}
@@ -1,8 +1,49 @@
 #pragma once
 
+#include "compact_note.h"
+
 #include "mx/api/ScoreData.h"
+#include <functional>
+#include <optional>
 #include <vector>
 
 const std::string read_file(const std::string& path);
 const mx::api::ScoreData get_score_object(const std::string& xml);
-const std::vector<mx::api::NoteData> create_voice_array(const mx::api::ScoreData& score);
\ No newline at end of file
+const mx::api::ScoreData read_score_file(const std::string& path); // Parses the memory-mapped file in place
+const std::vector<mx::api::NoteData> create_voice_array(const mx::api::ScoreData& score);
+
+// What the search needs from the input: the leader as create_voice_array() sees it (empty starting and trailing
+// measures removed), and the first measure's key, time signature and length
+struct SubjectData {
+	CompactVoice leader{};
+	int fifths{};
+	mx::api::TimeSignatureData time_signature{};
+	int ticks_per_measure{};
+	int measure_count{};
+};
+
+const SubjectData get_subject(const mx::api::ScoreData& score);
+
+// An input score whose subject was read straight off the pugixml tree, without building the mx::core document.
+// The full score is only needed as a template for output, so it's parsed the first time get_score() is called.
+// Inputs the fast path doesn't handle (several parts, staves or voices, chords, grace notes...) are parsed in
+// full right away
+class InputScore {
+public:
+	InputScore(const SubjectData& subject, const std::function<const mx::api::ScoreData()>& read_score);
+	explicit InputScore(const mx::api::ScoreData& score);
+
+	const SubjectData& get_subject() const {
+		return m_subject;
+	}
+
+	const mx::api::ScoreData& get_score() const; // Not thread safe
+
+private:
+	SubjectData m_subject{};
+	std::function<const mx::api::ScoreData()> m_read_score{};
+	mutable std::optional<mx::api::ScoreData> m_score{};
+};
+
+InputScore read_input_file(const std::string& path);
+InputScore read_input_string(const std::string& xml);
@@ -137,11 +137,46 @@ void write_file(const mx::api::ScoreData score, const std::string& path)
 
 #include "mx/api/DocumentManager.h"
 #include "mx/api/ScoreData.h"
+#include "mxl_writer.h"
+#include "exception.h"
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <system_error>
+#include <vector>
 
 // set this to 1 if you want to see the xml in your console
 #define MX_WRITE_THIS_TO_THE_CONSOLE 0
 
-void write_file(const mx::api::ScoreData score, const std::string& path) {
+void write_to_file(const std::string& path, const std::ios::openmode mode, const std::function<void(std::ostream&)>& write) {
+    // Hands the opened file to write and checks it once closed, since closing writes whatever is still buffered.
+    // If anything goes wrong after opening, the truncated file is removed before the error is reported
+    std::vector<char> buffer(64 * 1024);
+    std::ofstream file{};
+    file.rdbuf()->pubsetbuf(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+    file.open(path, mode | std::ios::out);
+    if (!file.is_open()) {
+        throw Exception{ "Could not write " + path + "!\n" };
+    }
+
+    try {
+        write(file);
+        file.close();
+        if (file.fail()) {
+            throw Exception{ "Could not write " + path + "!\n" };
+        }
+    }
+    catch (...) {
+        file.close();
+        std::error_code error{};
+        if (std::filesystem::is_regular_file(path, error)) { // Not /dev/stdout and the like
+            std::filesystem::remove(path, error); // The write error is the one worth reporting
+        }
+        throw;
+    }
+}
+
+void write_file(const mx::api::ScoreData& score, const std::string& path) {
     //using namespace mx::api;
     //const auto qticks = 4;
 
@@ -240,20 +275,32 @@ void write_file(const mx::api::ScoreData score, const std::string& path) {
     //note.beams.clear();
     //voice.notes.push_back(note);
 
-    // the document manager is the liaison between our score data and the MusicXML DOM.
-    // it completely hides the MusicXML DOM from us when using mx::api
+    // the score is written measure by measure, without building a document for the whole of it first
     auto& mgr = mx::api::DocumentManager::getInstance();
-    const auto documentID = mgr.createFromScore(score);
 
     // write to the console
 #if MX_WRITE_THIS_TO_THE_CONSOLE
-    mgr.writeToStream(documentID, std::cout);
+    mgr.writeScoreToStream(score, std::cout);
     std::cout << std::endl;
 #endif
 
-    // write to a file
-    mgr.writeToFile(documentID, path);
+    // write to a file. .mxl is compressed as it's written
+    if (std::filesystem::path{ path }.extension() == ".mxl") {
+        write_to_file(path, std::ios::binary, [&](std::ostream& file) {
+            write_mxl(file, [&](std::ostream& xml) {
+                mgr.writeScoreToStream(score, xml);
+            });
+        });
+        return;
+    }
+    write_to_file(path, std::ios::out, [&](std::ostream& file) {
+        mgr.writeScoreToStream(score, file);
+    });
+}
 
-    // we need to explicitly delete the object held by the manager
-    mgr.destroyDocument(documentID);
+const std::string write_string(const mx::api::ScoreData& score)
+{
+    std::ostringstream stream{};
+    mx::api::DocumentManager::getInstance().writeScoreToStream(score, stream);
+    return stream.str();
 }
@@ -2,4 +2,5 @@
 
 #include "mx/api/ScoreData.h"
 
-void write_file(const mx::api::ScoreData score, const std::string& path);
\ No newline at end of file
+void write_file(const mx::api::ScoreData& score, const std::string& path); // Streams the score out one measure at a time, compressed if path ends in .mxl
+const std::string write_string(const mx::api::ScoreData& score); // Same MusicXML as write_file, without touching the disk
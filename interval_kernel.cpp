@@ -0,0 +1,181 @@
+#include "interval_kernel.h"
+
+#include <cstdlib>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define INTERVAL_KERNEL_SIMD
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define INTERVAL_KERNEL_SIMD
+#endif
+
+// MotionType values, as in sonority.h
+constexpr std::int16_t motion_contrary{ 0 };
+constexpr std::int16_t motion_oblique{ 1 };
+constexpr std::int16_t motion_similar{ 2 };
+constexpr std::int16_t motion_stationary{ 3 };
+
+// x / 7 and x / 12 as (x * magic) >> 16. Exact for 0 <= x < 8192, far beyond any interval between two notes
+constexpr std::int16_t divide_by_7_magic{ 9363 };
+constexpr std::int16_t divide_by_12_magic{ 5462 };
+
+std::int16_t scalar_motion_type(const std::int16_t voice_1_semitones, const std::int16_t voice_2_semitones) {
+	const int sign_1{ (voice_1_semitones > 0) - (voice_1_semitones < 0) };
+	const int sign_2{ (voice_2_semitones > 0) - (voice_2_semitones < 0) };
+	if (sign_1 == sign_2) {
+		return (sign_1 == 0) ? motion_stationary : motion_similar;
+	}
+	return (sign_1 == 0 || sign_2 == 0) ? motion_oblique : motion_contrary;
+}
+
+void scalar_intervals(const VoiceColumns& voice_1, const VoiceColumns& voice_2, IntervalColumns& output, const std::size_t first, const std::size_t last) {
+	for (std::size_t i{ first }; i < last; ++i) {
+		if (voice_1.rest_masks[i] != 0 || voice_2.rest_masks[i] != 0) {
+			output.signed_diatonic[i] = output.compound_diatonic[i] = output.simple_diatonic[i] = interval_rest_code;
+			output.signed_semitones[i] = output.compound_semitones[i] = output.simple_semitones[i] = interval_rest_code;
+			continue;
+		}
+		const int diatonic{ voice_2.diatonic_indices[i] - voice_1.diatonic_indices[i] };
+		const int semitones{ voice_2.semitone_indices[i] - voice_1.semitone_indices[i] };
+		output.signed_diatonic[i] = static_cast<std::int16_t>(diatonic);
+		output.signed_semitones[i] = static_cast<std::int16_t>(semitones);
+		output.compound_diatonic[i] = static_cast<std::int16_t>(std::abs(diatonic));
+		output.compound_semitones[i] = static_cast<std::int16_t>(std::abs(semitones));
+		output.simple_diatonic[i] = static_cast<std::int16_t>(std::abs(diatonic) % 7);
+		output.simple_semitones[i] = static_cast<std::int16_t>(std::abs(semitones) % 12);
+	}
+}
+
+void scalar_motions(const VoiceColumns& voice_1, const VoiceColumns& voice_2, MotionColumns& output, const std::size_t first, const std::size_t last) {
+	for (std::size_t i{ first }; i < last; ++i) {
+		const bool voice_1_rest{ voice_1.rest_masks[i] != 0 || voice_1.rest_masks[i + 1] != 0 };
+		const bool voice_2_rest{ voice_2.rest_masks[i] != 0 || voice_2.rest_masks[i + 1] != 0 };
+		output.voice_1_diatonic[i] = voice_1_rest ? interval_rest_code : static_cast<std::int16_t>(voice_1.diatonic_indices[i + 1] - voice_1.diatonic_indices[i]);
+		output.voice_1_semitones[i] = voice_1_rest ? interval_rest_code : static_cast<std::int16_t>(voice_1.semitone_indices[i + 1] - voice_1.semitone_indices[i]);
+		output.voice_2_diatonic[i] = voice_2_rest ? interval_rest_code : static_cast<std::int16_t>(voice_2.diatonic_indices[i + 1] - voice_2.diatonic_indices[i]);
+		output.voice_2_semitones[i] = voice_2_rest ? interval_rest_code : static_cast<std::int16_t>(voice_2.semitone_indices[i + 1] - voice_2.semitone_indices[i]);
+		output.motion_types[i] = scalar_motion_type(output.voice_1_semitones[i], output.voice_2_semitones[i]);
+	}
+}
+
+#ifdef INTERVAL_KERNEL_SIMD
+// The few operations the kernels need, so they're written once for both register widths
+#if defined(__AVX2__)
+using Lanes = __m256i;
+constexpr std::size_t lane_count{ 16 };
+Lanes lanes_load(const std::int16_t* source) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source)); }
+void lanes_store(std::int16_t* destination, const Lanes value) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination), value); }
+Lanes lanes_splat(const std::int16_t value) { return _mm256_set1_epi16(value); }
+Lanes lanes_subtract(const Lanes a, const Lanes b) { return _mm256_sub_epi16(a, b); }
+Lanes lanes_multiply(const Lanes a, const Lanes b) { return _mm256_mullo_epi16(a, b); }
+Lanes lanes_multiply_high_unsigned(const Lanes a, const Lanes b) { return _mm256_mulhi_epu16(a, b); }
+Lanes lanes_maximum(const Lanes a, const Lanes b) { return _mm256_max_epi16(a, b); }
+Lanes lanes_bitwise_and(const Lanes a, const Lanes b) { return _mm256_and_si256(a, b); }
+Lanes lanes_bitwise_or(const Lanes a, const Lanes b) { return _mm256_or_si256(a, b); }
+Lanes lanes_and_not(const Lanes a, const Lanes b) { return _mm256_andnot_si256(a, b); } // ~a & b
+Lanes lanes_equal(const Lanes a, const Lanes b) { return _mm256_cmpeq_epi16(a, b); }
+Lanes lanes_greater(const Lanes a, const Lanes b) { return _mm256_cmpgt_epi16(a, b); }
+#else
+using Lanes = __m128i;
+constexpr std::size_t lane_count{ 8 };
+Lanes lanes_load(const std::int16_t* source) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(source)); }
+void lanes_store(std::int16_t* destination, const Lanes value) { _mm_storeu_si128(reinterpret_cast<__m128i*>(destination), value); }
+Lanes lanes_splat(const std::int16_t value) { return _mm_set1_epi16(value); }
+Lanes lanes_subtract(const Lanes a, const Lanes b) { return _mm_sub_epi16(a, b); }
+Lanes lanes_multiply(const Lanes a, const Lanes b) { return _mm_mullo_epi16(a, b); }
+Lanes lanes_multiply_high_unsigned(const Lanes a, const Lanes b) { return _mm_mulhi_epu16(a, b); }
+Lanes lanes_maximum(const Lanes a, const Lanes b) { return _mm_max_epi16(a, b); }
+Lanes lanes_bitwise_and(const Lanes a, const Lanes b) { return _mm_and_si128(a, b); }
+Lanes lanes_bitwise_or(const Lanes a, const Lanes b) { return _mm_or_si128(a, b); }
+Lanes lanes_and_not(const Lanes a, const Lanes b) { return _mm_andnot_si128(a, b); } // ~a & b
+Lanes lanes_equal(const Lanes a, const Lanes b) { return _mm_cmpeq_epi16(a, b); }
+Lanes lanes_greater(const Lanes a, const Lanes b) { return _mm_cmpgt_epi16(a, b); }
+#endif
+
+Lanes lanes_select(const Lanes mask, const Lanes if_set, const Lanes if_clear) {
+	return lanes_bitwise_or(lanes_bitwise_and(mask, if_set), lanes_and_not(mask, if_clear));
+}
+
+Lanes lanes_absolute(const Lanes value) {
+	return lanes_maximum(value, lanes_subtract(lanes_splat(0), value));
+}
+
+Lanes lanes_remainder(const Lanes value, const std::int16_t divisor, const std::int16_t magic) {
+	// value must not be negative
+	const Lanes quotient{ lanes_multiply_high_unsigned(value, lanes_splat(magic)) };
+	return lanes_subtract(value, lanes_multiply(quotient, lanes_splat(divisor)));
+}
+
+Lanes lanes_sign(const Lanes value) {
+	// -1, 0 or 1. A compare gives -1 where true
+	return lanes_subtract(lanes_greater(lanes_splat(0), value), lanes_greater(value, lanes_splat(0)));
+}
+
+Lanes lanes_motion_type(const Lanes voice_1_semitones, const Lanes voice_2_semitones) {
+	const Lanes sign_1{ lanes_sign(voice_1_semitones) };
+	const Lanes sign_2{ lanes_sign(voice_2_semitones) };
+	const Lanes same_direction{ lanes_equal(sign_1, sign_2) };
+	const Lanes either_stationary{ lanes_bitwise_or(lanes_equal(sign_1, lanes_splat(0)), lanes_equal(sign_2, lanes_splat(0))) };
+	const Lanes if_same{ lanes_select(either_stationary, lanes_splat(motion_stationary), lanes_splat(motion_similar)) };
+	const Lanes if_different{ lanes_select(either_stationary, lanes_splat(motion_oblique), lanes_splat(motion_contrary)) };
+	return lanes_select(same_direction, if_same, if_different);
+}
+#endif
+
+void compute_intervals(const VoiceColumns& voice_1, const VoiceColumns& voice_2, IntervalColumns& output) {
+	const std::size_t size{ voice_1.size() };
+	for (std::pmr::vector<std::int16_t>* column : { &output.signed_diatonic, &output.signed_semitones, &output.compound_diatonic,
+		&output.compound_semitones, &output.simple_diatonic, &output.simple_semitones }) {
+		column->resize(size);
+	}
+
+	std::size_t i{ 0 };
+#ifdef INTERVAL_KERNEL_SIMD
+	const Lanes rest_code{ lanes_splat(interval_rest_code) };
+	for (; i + lane_count <= size; i += lane_count) {
+		const Lanes rests{ lanes_bitwise_or(lanes_load(&voice_1.rest_masks[i]), lanes_load(&voice_2.rest_masks[i])) };
+		const Lanes signed_diatonic{ lanes_subtract(lanes_load(&voice_2.diatonic_indices[i]), lanes_load(&voice_1.diatonic_indices[i])) };
+		const Lanes signed_semitones{ lanes_subtract(lanes_load(&voice_2.semitone_indices[i]), lanes_load(&voice_1.semitone_indices[i])) };
+		const Lanes compound_diatonic{ lanes_absolute(signed_diatonic) };
+		const Lanes compound_semitones{ lanes_absolute(signed_semitones) };
+		lanes_store(&output.signed_diatonic[i], lanes_select(rests, rest_code, signed_diatonic));
+		lanes_store(&output.signed_semitones[i], lanes_select(rests, rest_code, signed_semitones));
+		lanes_store(&output.compound_diatonic[i], lanes_select(rests, rest_code, compound_diatonic));
+		lanes_store(&output.compound_semitones[i], lanes_select(rests, rest_code, compound_semitones));
+		lanes_store(&output.simple_diatonic[i], lanes_select(rests, rest_code, lanes_remainder(compound_diatonic, 7, divide_by_7_magic)));
+		lanes_store(&output.simple_semitones[i], lanes_select(rests, rest_code, lanes_remainder(compound_semitones, 12, divide_by_12_magic)));
+	}
+#endif
+	scalar_intervals(voice_1, voice_2, output, i, size);
+}
+
+void compute_motions(const VoiceColumns& voice_1, const VoiceColumns& voice_2, MotionColumns& output) {
+	const std::size_t size{ voice_1.size() };
+	for (std::pmr::vector<std::int16_t>* column : { &output.voice_1_diatonic, &output.voice_1_semitones, &output.voice_2_diatonic,
+		&output.voice_2_semitones }) {
+		column->assign(size, 0);
+	}
+	output.motion_types.assign(size, motion_stationary);
+	if (size < 2) {
+		return;
+	}
+
+	const std::size_t motion_count{ size - 1 }; // Lane i reads sonorities i and i + 1
+	std::size_t i{ 0 };
+#ifdef INTERVAL_KERNEL_SIMD
+	const Lanes rest_code{ lanes_splat(interval_rest_code) };
+	for (; i + lane_count <= motion_count; i += lane_count) {
+		const Lanes voice_1_rests{ lanes_bitwise_or(lanes_load(&voice_1.rest_masks[i]), lanes_load(&voice_1.rest_masks[i + 1])) };
+		const Lanes voice_2_rests{ lanes_bitwise_or(lanes_load(&voice_2.rest_masks[i]), lanes_load(&voice_2.rest_masks[i + 1])) };
+		const Lanes voice_1_semitones{ lanes_select(voice_1_rests, rest_code, lanes_subtract(lanes_load(&voice_1.semitone_indices[i + 1]), lanes_load(&voice_1.semitone_indices[i]))) };
+		const Lanes voice_2_semitones{ lanes_select(voice_2_rests, rest_code, lanes_subtract(lanes_load(&voice_2.semitone_indices[i + 1]), lanes_load(&voice_2.semitone_indices[i]))) };
+		lanes_store(&output.voice_1_diatonic[i], lanes_select(voice_1_rests, rest_code, lanes_subtract(lanes_load(&voice_1.diatonic_indices[i + 1]), lanes_load(&voice_1.diatonic_indices[i]))));
+		lanes_store(&output.voice_1_semitones[i], voice_1_semitones);
+		lanes_store(&output.voice_2_diatonic[i], lanes_select(voice_2_rests, rest_code, lanes_subtract(lanes_load(&voice_2.diatonic_indices[i + 1]), lanes_load(&voice_2.diatonic_indices[i]))));
+		lanes_store(&output.voice_2_semitones[i], voice_2_semitones);
+		lanes_store(&output.motion_types[i], lanes_motion_type(voice_1_semitones, voice_2_semitones));
+	}
+#endif
+	scalar_motions(voice_1, voice_2, output, i, motion_count);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <memory_resource>
+#include <vector>
+
+// Interval arithmetic for a whole voice pair at once. Each voice is laid out as a structure of arrays, lane i
+// being the note of sonority i, so the same subtraction, abs and modulo run on eight (SSE2) or sixteen (AVX2)
+// sonorities per instruction. Other targets get the scalar loop. Results are the same as get_interval() per note,
+// including the rest code. Columns live in the memory resource they're given, usually the checker's scratch arena
+
+inline constexpr std::int16_t interval_rest_code{ -1000 };
+
+struct VoiceColumns {
+	std::pmr::vector<std::int16_t> diatonic_indices;
+	std::pmr::vector<std::int16_t> semitone_indices;
+	std::pmr::vector<std::int16_t> rest_masks; // -1 (all bits set) for a rest, 0 for a note
+
+	VoiceColumns(const std::size_t size, std::pmr::memory_resource* resource)
+		: diatonic_indices(size, resource), semitone_indices(size, resource), rest_masks(size, resource) {
+	}
+
+	const std::size_t size() const {
+		return rest_masks.size();
+	}
+};
+
+// Intervals from voice_1 to voice_2 in each sonority. Signed is positive when voice_2 is higher
+struct IntervalColumns {
+	std::pmr::vector<std::int16_t> signed_diatonic;
+	std::pmr::vector<std::int16_t> signed_semitones;
+	std::pmr::vector<std::int16_t> compound_diatonic;
+	std::pmr::vector<std::int16_t> compound_semitones;
+	std::pmr::vector<std::int16_t> simple_diatonic;
+	std::pmr::vector<std::int16_t> simple_semitones;
+
+	explicit IntervalColumns(std::pmr::memory_resource* resource)
+		: signed_diatonic(resource), signed_semitones(resource), compound_diatonic(resource),
+		compound_semitones(resource), simple_diatonic(resource), simple_semitones(resource) {
+	}
+};
+
+// Motion of each voice from sonority i to sonority i + 1, and the MotionType of the pair. Zero (stationary) in
+// the last sonority
+struct MotionColumns {
+	std::pmr::vector<std::int16_t> voice_1_diatonic;
+	std::pmr::vector<std::int16_t> voice_1_semitones;
+	std::pmr::vector<std::int16_t> voice_2_diatonic;
+	std::pmr::vector<std::int16_t> voice_2_semitones;
+	std::pmr::vector<std::int16_t> motion_types; // MotionType values
+
+	explicit MotionColumns(std::pmr::memory_resource* resource)
+		: voice_1_diatonic(resource), voice_1_semitones(resource), voice_2_diatonic(resource),
+		voice_2_semitones(resource), motion_types(resource) {
+	}
+};
+
+void compute_intervals(const VoiceColumns& voice_1, const VoiceColumns& voice_2, IntervalColumns& output);
+void compute_motions(const VoiceColumns& voice_1, const VoiceColumns& voice_2, MotionColumns& output);
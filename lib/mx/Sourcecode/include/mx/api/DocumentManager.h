@@ -6,6 +6,7 @@
 
 #include "mx/api/ScoreData.h"
 
+#include <cstddef>
 #include <ostream>
 #include <memory>
 
@@ -30,6 +31,8 @@ namespace mx
             
             // this class is a singleton, get it like this
             // auto& docMngr = DocumentManager::getInstance()
+            // it is thread safe, and threads working on different documents
+            // can parse, read and write them at the same time
             static DocumentManager& getInstance();
             
             
@@ -41,6 +44,13 @@ namespace mx
             // creates a MusicXML document from a character stream
             // and returns the document's ID number, -1 if error
             int createFromStream( std::istream& stream );
+
+
+            // creates a MusicXML document from xml in memory, parsing it in
+            // place instead of copying it. the buffer is modified and only
+            // needs to stay valid until this returns. returns the document's
+            // ID number, -1 if error
+            int createFromBuffer( void* data, std::size_t size );
             
             
             // creates a MusicXML document from a Score structure
@@ -57,6 +67,20 @@ namespace mx
             // character stream, -1 if error
             void writeToStream( int documentId, std::ostream& stream ) const;
 
+
+            // writes a Score structure to a character stream without
+            // creating a document. the header and part list go first,
+            // then each measure as soon as it is converted, so memory
+            // use scales with one measure rather than the whole score.
+            // the output is the same as createFromScore followed by
+            // writeToStream
+            void writeScoreToStream( const ScoreData& score, std::ostream& stream ) const;
+
+
+            // writes a Score structure to a file like writeScoreToStream,
+            // throws std::runtime_error if the file can't be opened or written
+            void writeScoreToFile( const ScoreData& score, const std::string& filePath ) const;
+
             
             // retreives the data from an existing document
             // and returns it in the Score structure.  if id
@@ -80,7 +104,7 @@ namespace mx
             // returns a unique number and increments the unique number
             // generator. this is here as an aid to any client code that
             // needs unique numbers since DocumentManager is already a
-            // thread-locking singleton, it can easily implement this.
+            // thread-safe singleton, it can easily implement this.
             int getUniqueId();
             
         private:
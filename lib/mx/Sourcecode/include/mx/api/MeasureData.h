@@ -101,6 +101,11 @@ namespace mx
             {
                 
             }
+
+            /// sorts the clefs, directions and notes of each
+            /// staff by time. ScoreData::sort calls this for
+            /// every measure.
+            void sort();
         };
         
         MXAPI_EQUALS_BEGIN( MeasureData )
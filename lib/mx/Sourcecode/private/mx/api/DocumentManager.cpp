@@ -6,38 +6,95 @@
 #include "mx/impl/ScoreReader.h"
 #include "mx/impl/ScoreWriter.h"
 #include "mx/core/Document.h"
+#include "mx/core/elements/PartwiseMeasure.h"
 #include "ezxml/XFactory.h"
 #include "mx/utility/Throw.h"
 
-#define LOCK_DOCUMENT_MANAGER std::lock_guard<std::mutex> lock(myImpl->myMutex);
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <vector>
 
 namespace mx
 {
     namespace api
     {
         using DocumentMap = std::map<int, mx::core::DocumentPtr>;
+
+        // documents are spread over shards by id, so threads working on different
+        // documents rarely wait for each other. a shard is only locked while a
+        // document is added, found or removed, not while it is parsed, read or
+        // written. timewise documents are the exception: getData converts them in
+        // place, so they are only ever used with their shard locked
         class DocumentManager::Impl
         {
         public:
-            std::mutex myMutex;
-            int myCurrentId;
-            DocumentMap myMap;
-            int myCurrentUniqueId;
+            static constexpr int ShardCount = 16;
+
+            struct Shard
+            {
+                std::mutex myMutex;
+                DocumentMap myMap;
+            };
+
+            std::array<Shard, ShardCount> myShards;
+            std::atomic<int> myCurrentId;
+            std::atomic<int> myCurrentUniqueId;
 
             Impl()
-            : myMutex{}
-            , myCurrentId{0}
-            , myMap{}
+            : myShards{}
+            , myCurrentId{1}
             , myCurrentUniqueId{1000000}
             {
 
             }
+
+            Shard& getShard( int documentId )
+            {
+                return myShards[static_cast<unsigned int>( documentId ) % ShardCount];
+            }
+
+            int insert( mx::core::DocumentPtr mxdoc )
+            {
+                const int documentId = myCurrentId++;
+                auto& shard = getShard( documentId );
+                std::lock_guard<std::mutex> lock{ shard.myMutex };
+                shard.myMap[documentId] = std::move( mxdoc );
+                return documentId;
+            }
+
+            // returns nullptr if the documentId is bad. lock is left holding the
+            // shard's lock if the document is timewise, and unlocked otherwise
+            mx::core::DocumentPtr find( int documentId, std::unique_lock<std::mutex>& lock )
+            {
+                auto& shard = getShard( documentId );
+                lock = std::unique_lock<std::mutex>{ shard.myMutex };
+                const DocumentMap::const_iterator it = shard.myMap.find( documentId );
+
+                if( it == shard.myMap.cend() )
+                {
+                    return mx::core::DocumentPtr{};
+                }
+
+                auto mxdoc = it->second;
+
+                if( mxdoc->getChoice() != core::DocumentChoice::timewise )
+                {
+                    lock.unlock();
+                }
+
+                return mxdoc;
+            }
         };
         
         DocumentManager::DocumentManager()
             : myImpl{ new DocumentManager::Impl() }
         {
-            myImpl->myCurrentId = 1;
+
         }
         
         
@@ -99,9 +156,7 @@ namespace mx
                 MX_THROW( messages.str() );
             }
             
-            LOCK_DOCUMENT_MANAGER
-            myImpl->myMap[myImpl->myCurrentId] = std::move( mxdoc );
-            return myImpl->myCurrentId++;
+            return myImpl->insert( std::move( mxdoc ) );
         }
         
         
@@ -119,12 +174,28 @@ namespace mx
                 MX_THROW( messages.str() );
             }
             
-            LOCK_DOCUMENT_MANAGER
-            myImpl->myMap[myImpl->myCurrentId] = std::move( mxdoc );
-            return myImpl->myCurrentId++;
+            return myImpl->insert( std::move( mxdoc ) );
         }
         
         
+        int DocumentManager::createFromBuffer( void* data, std::size_t size )
+        {
+            auto xdoc = ::ezxml::XFactory::makeXDoc();
+            xdoc->loadBufferInPlace( data, size );
+            auto mxdoc = mx::core::makeDocument();
+
+            std::stringstream messages;
+            auto isSuccess = mxdoc->fromXDoc( messages, *xdoc );
+
+            if( !isSuccess )
+            {
+                MX_THROW( messages.str() );
+            }
+
+            return myImpl->insert( std::move( mxdoc ) );
+        }
+
+
         int DocumentManager::createFromScore( const ScoreData& score )
         {
             impl::ScoreWriter writer{ score };
@@ -138,72 +209,134 @@ namespace mx
                 mxdoc->convertContents();
             }
             
-            LOCK_DOCUMENT_MANAGER
-            myImpl->myMap[myImpl->myCurrentId] = std::move( mxdoc );
-            return myImpl->myCurrentId++;
+            return myImpl->insert( std::move( mxdoc ) );
         }
         
         
         void DocumentManager::writeToFile( int documentId, const std::string& filePath ) const
         {
-            LOCK_DOCUMENT_MANAGER
-            
-            const DocumentMap::const_iterator it = myImpl->myMap.find( documentId );
+            std::unique_lock<std::mutex> lock;
+            const auto mxdoc = myImpl->find( documentId, lock );
             
-            if( it == myImpl->myMap.cend() )
+            if( !mxdoc )
             {
                 return;
             }
             
             auto xdoc = ::ezxml::XFactory::makeXDoc();
-            it->second->toXDoc( *xdoc );
+            mxdoc->toXDoc( *xdoc );
             xdoc->saveFile( filePath );
         }
         
         
         void DocumentManager::writeToStream( int documentId, std::ostream& stream ) const
         {
-            LOCK_DOCUMENT_MANAGER
+            std::unique_lock<std::mutex> lock;
+            const auto mxdoc = myImpl->find( documentId, lock );
             
-            const DocumentMap::const_iterator it = myImpl->myMap.find( documentId );
-            
-            if( it == myImpl->myMap.cend() )
+            if( !mxdoc )
             {
                 return;
             }
             
             auto xdoc = ::ezxml::XFactory::makeXDoc();
-            it->second->toXDoc( *xdoc );
+            mxdoc->toXDoc( *xdoc );
             xdoc->saveStream( stream );
         }
 
+
+        void DocumentManager::writeScoreToStream( const ScoreData& score, std::ostream& stream ) const
+        {
+            impl::ScoreWriter writer{ score };
+            auto mxdoc = core::makeDocument();
+            mxdoc->setChoice( core::DocumentChoice::partwise );
+            auto xdoc = ::ezxml::XFactory::makeXDoc();
+
+            // timewise output is converted from the whole partwise document, and
+            // parts without measures keep the empty one core gives them, so those
+            // scores are written the old way
+            const auto hasNoMeasures = []( const PartData& part ) { return part.measures.empty(); };
+            if( score.musicXmlType == "timewise" || score.parts.empty() ||
+                std::any_of( score.parts.cbegin(), score.parts.cend(), hasNoMeasures ) )
+            {
+                mxdoc->setScorePartwise( writer.getScorePartwise() );
+                if( score.musicXmlType == "timewise" )
+                {
+                    mxdoc->convertContents();
+                }
+                mxdoc->toXDoc( *xdoc );
+                xdoc->saveStream( stream );
+                return;
+            }
+
+            mxdoc->setScorePartwise( writer.getEmptyScorePartwise() );
+            mxdoc->toXDoc( *xdoc );
+
+            // each measure still goes through core and pugixml, but only one
+            // measure at a time, and pugixml formats it the same way it would
+            // have formatted the whole document
+            std::stringstream measureStream;
+            const auto measureDoc = ::ezxml::XFactory::makeXDoc();
+            const auto writeMeasures = [&]( std::ostream& os, int partIndex, int depth )
+            {
+                writer.writeMeasures( partIndex, [&]( const core::PartwiseMeasurePtr& measure )
+                {
+                    measureStream.str( "" );
+                    measureStream.clear();
+                    measure->toStream( measureStream, 0 );
+                    measureDoc->loadStream( measureStream );
+                    measureDoc->saveFragmentStream( os, depth );
+                } );
+            };
+
+            xdoc->saveStream( stream, "part", writeMeasures );
+        }
+
+
+        void DocumentManager::writeScoreToFile( const ScoreData& score, const std::string& filePath ) const
+        {
+            std::vector<char> buffer( 64 * 1024 );
+            std::ofstream file;
+            file.rdbuf()->pubsetbuf( buffer.data(), static_cast<std::streamsize>( buffer.size() ) );
+            file.open( filePath.c_str() );
+            if( !file.is_open() )
+            {
+                throw std::runtime_error( std::string{ "error opening file for writing: " } + filePath );
+            }
+
+            writeScoreToStream( score, file );
+            file.close(); // writes whatever is still buffered, so it's checked too
+            if( file.fail() )
+            {
+                throw std::runtime_error( std::string{ "error writing file: " } + filePath );
+            }
+        }
+
         
         ScoreData DocumentManager::getData( int documentId ) const
         {
-            LOCK_DOCUMENT_MANAGER
+            std::unique_lock<std::mutex> lock;
+            const auto mxdoc = myImpl->find( documentId, lock );
             
-            const DocumentMap::const_iterator it = myImpl->myMap.find( documentId );
-            
-            if( it == myImpl->myMap.cend() )
+            if( !mxdoc )
             {
                 return ScoreData{};
             }
             
-            bool wasTimewise = false;
+            const bool wasTimewise = lock.owns_lock();
 
-            if( it->second->getChoice() == core::DocumentChoice::timewise )
+            if( wasTimewise )
             {
-                wasTimewise = true;
-                it->second->convertContents();
+                mxdoc->convertContents();
             }
 
-            impl::ScoreReader reader{ *it->second->getScorePartwise() };
+            impl::ScoreReader reader{ *mxdoc->getScorePartwise() };
             auto score = reader.getScoreData();
 
             if( wasTimewise )
             {
                 score.musicXmlType = "timewise";
-                it->second->convertContents();
+                mxdoc->convertContents();
             }
             return score;
         }
@@ -211,24 +344,19 @@ namespace mx
         
         void DocumentManager::destroyDocument( int documentId )
         {
-            LOCK_DOCUMENT_MANAGER
-            const DocumentMap::const_iterator it = myImpl->myMap.find( documentId );
-            
-            if( it == myImpl->myMap.cend() )
-            {
-                return;
-            }
-            
-            myImpl->myMap.erase( it );
+            auto& shard = myImpl->getShard( documentId );
+            std::lock_guard<std::mutex> lock{ shard.myMutex };
+            shard.myMap.erase( documentId );
         }
         
         
         mx::core::DocumentPtr DocumentManager::getDocument( int documentId ) const
         {
-            LOCK_DOCUMENT_MANAGER
-            const DocumentMap::const_iterator it = myImpl->myMap.find( documentId );
+            auto& shard = myImpl->getShard( documentId );
+            std::lock_guard<std::mutex> lock{ shard.myMutex };
+            const DocumentMap::const_iterator it = shard.myMap.find( documentId );
             
-            if( it == myImpl->myMap.cend() )
+            if( it == shard.myMap.cend() )
             {
                 return mx::core::DocumentPtr{};
             }
@@ -238,10 +366,7 @@ namespace mx
 
         int DocumentManager::getUniqueId()
         {
-            LOCK_DOCUMENT_MANAGER
-            int returnValue = myImpl->myCurrentUniqueId;
-            ++myImpl->myCurrentUniqueId;
-            return returnValue;
+            return myImpl->myCurrentUniqueId++;
         }
     }
 }
@@ -68,33 +68,39 @@ namespace mx
             {
                 for( auto& measure : part.measures )
                 {
-                    for ( auto& staff : measure.staves )
-                    {
+                    measure.sort();
+                }
+            }
+        }
+
+
+        void MeasureData::sort()
+        {
+            for ( auto& staff : staves )
+            {
 
-                        const auto clefCompare = [&]( ClefData& inLeft, ClefData& inRight )
-                        {
-                            return inLeft.tickTimePosition < inRight.tickTimePosition;
-                        };
+                const auto clefCompare = [&]( ClefData& inLeft, ClefData& inRight )
+                {
+                    return inLeft.tickTimePosition < inRight.tickTimePosition;
+                };
 
-                        std::sort( std::begin( staff.clefs ), std::end( staff.clefs ), clefCompare );
+                std::sort( std::begin( staff.clefs ), std::end( staff.clefs ), clefCompare );
 
-                        const auto directionCompare = [&]( DirectionData& inLeft, DirectionData& inRight )
-                        {
-                            return inLeft.tickTimePosition < inRight.tickTimePosition;
-                        };
+                const auto directionCompare = [&]( DirectionData& inLeft, DirectionData& inRight )
+                {
+                    return inLeft.tickTimePosition < inRight.tickTimePosition;
+                };
 
-                        std::sort( std::begin( staff.directions ), std::end( staff.directions ), directionCompare );
+                std::sort( std::begin( staff.directions ), std::end( staff.directions ), directionCompare );
 
-                        for ( auto& voice : staff.voices )
-                        {
-                            const auto noteCompare = [&]( NoteData& inLeft, NoteData& inRight )
-                            {
-                                return inLeft.tickTimePosition < inRight.tickTimePosition;
-                            };
+                for ( auto& voice : staff.voices )
+                {
+                    const auto noteCompare = [&]( NoteData& inLeft, NoteData& inRight )
+                    {
+                        return inLeft.tickTimePosition < inRight.tickTimePosition;
+                    };
 
-                            std::sort( std::begin( voice.second.notes ), std::end( voice.second.notes ), noteCompare );
-                        }
-                    }
+                    std::sort( std::begin( voice.second.notes ), std::end( voice.second.notes ), noteCompare );
                 }
             }
         }
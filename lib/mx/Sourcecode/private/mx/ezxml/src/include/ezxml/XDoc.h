@@ -5,8 +5,11 @@
 #include "ezxml/XDocSpec.h"
 #include "ezxml/XElement.h"
 
+#include <cstddef>
+#include <functional>
 #include <iostream>
 #include <memory>
+#include <string>
 
 namespace ezxml
 {
@@ -17,12 +20,30 @@ namespace ezxml
     class XDoc : public std::enable_shared_from_this<XDoc>
     {
     public:
+        using ChildWriter = std::function<void( std::ostream& os, int index, int depth )>;
+
         virtual ~XDoc() = default;
 
         // these can throw std::runtime_error
         virtual void loadStream( std::istream& is ) = 0;
         virtual void saveStream( std::ostream& os ) const = 0;
 
+        // parses the xml without copying it first. the buffer is modified and
+        // must outlive the XDoc (or the next load call). can throw std::runtime_error
+        virtual void loadBufferInPlace( void* data, std::size_t size ) = 0;
+
+        // writes the document like saveStream, except that the children of each
+        // element named elementName are replaced by whatever writeChildren writes.
+        // writeChildren gets the element's index among the elements of that name
+        // and the depth its children are indented to. such elements always get an
+        // open and a close tag. always writes UTF-8
+        virtual void saveStream( std::ostream& os, const std::string& elementName, const ChildWriter& writeChildren ) const = 0;
+
+        // writes everything but the xml and doctype declarations, indented the way
+        // saveStream would indent it if it were nested depth elements deep. always
+        // writes UTF-8
+        virtual void saveFragmentStream( std::ostream& os, int depth ) const = 0;
+
         // these can throw std::runtime_error
         virtual void loadFile( const std::string& filename ) = 0;
         virtual void saveFile( const std::string& filename ) const = 0;
@@ -6,6 +6,7 @@
 #include "private/Parse.h"
 
 #include <fstream>
+#include <sstream>
 
 namespace ezxml
 {
@@ -13,6 +14,70 @@ namespace ezxml
     static constexpr unsigned int standardOptions =
             pugi::parse_default | pugi::parse_declaration | pugi::parse_doctype | pugi::parse_pi;
 
+    static constexpr const char* standardIndent = "  ";
+
+
+    static void
+    indentStream( std::ostream& os, unsigned int depth )
+    {
+        for( unsigned int i = 0; i < depth; ++i )
+        {
+            os << standardIndent;
+        }
+    }
+
+
+    // writes the node the way xml_document::save would, except that the children of
+    // elements named elementName come from writeChildren
+    static void
+    saveNodeStream( std::ostream& os, const pugi::xml_node& node, unsigned int depth,
+        const std::string& elementName, const XDoc::ChildWriter& writeChildren, int& index )
+    {
+        const auto isElementName = [&elementName]( const pugi::xml_node& n )
+        {
+            return n.type() == pugi::node_element && elementName == n.name();
+        };
+
+        const bool isReplaced = isElementName( node );
+        if( !isReplaced && !node.find_node( isElementName ) )
+        {
+            pugi::xml_writer_stream writer( os );
+            node.print( writer, standardIndent, pugi::format_indent, pugi::encoding_utf8, depth );
+            return;
+        }
+
+        // let pugixml write the tag, so attributes are escaped the same way
+        pugi::xml_document tagDoc;
+        auto tag = tagDoc.append_child( node.name() );
+        for( const auto& attribute : node.attributes() )
+        {
+            tag.append_copy( attribute );
+        }
+        tag.append_child( pugi::node_pcdata );
+        std::ostringstream tagStream;
+        tag.print( tagStream, "", pugi::format_raw, pugi::encoding_utf8 );
+        const auto tagText = tagStream.str();
+        const std::string closeTag = std::string{ "</" } + node.name() + ">";
+
+        indentStream( os, depth );
+        os << tagText.substr( 0, tagText.size() - closeTag.size() ) << "\n";
+
+        if( isReplaced )
+        {
+            writeChildren( os, index++, static_cast<int>( depth + 1 ) );
+        }
+        else
+        {
+            for( const auto& child : node.children() )
+            {
+                saveNodeStream( os, child, depth + 1, elementName, writeChildren, index );
+            }
+        }
+
+        indentStream( os, depth );
+        os << closeTag << "\n";
+    }
+
 
     PugiDoc::PugiDoc()
             : myDoc(),
@@ -31,7 +96,20 @@ namespace ezxml
     void
     PugiDoc::loadStream( std::istream& is )
     {
-        auto parseResult = myDoc.load( is, standardOptions );
+        finishLoad( myDoc.load( is, standardOptions ) );
+    }
+
+
+    void
+    PugiDoc::loadBufferInPlace( void* data, std::size_t size )
+    {
+        finishLoad( myDoc.load_buffer_inplace( data, size, standardOptions ) );
+    }
+
+
+    void
+    PugiDoc::finishLoad( const pugi::xml_parse_result& parseResult )
+    {
         if( parseResult.status != pugi::status_ok )
         {
             std::stringstream ss;
@@ -189,7 +267,37 @@ namespace ezxml
         }
 
         pugi::xml_writer_stream writer( os );
-        myDoc.save( writer, "  ", flags, pugiEncoding );
+        myDoc.save( writer, standardIndent, flags, pugiEncoding );
+    }
+
+
+    void
+    PugiDoc::saveStream( std::ostream& os, const std::string& elementName, const ChildWriter& writeChildren ) const
+    {
+        if( myDoWriteBom )
+        {
+            os << "\xEF\xBB\xBF";
+        }
+
+        int index = 0;
+        for( const auto& node : myDoc.children() )
+        {
+            saveNodeStream( os, node, 0, elementName, writeChildren, index );
+        }
+    }
+
+
+    void
+    PugiDoc::saveFragmentStream( std::ostream& os, int depth ) const
+    {
+        pugi::xml_writer_stream writer( os );
+        for( const auto& node : myDoc.children() )
+        {
+            if( node.type() != pugi::node_declaration && node.type() != pugi::node_doctype )
+            {
+                node.print( writer, standardIndent, pugi::format_indent, pugi::encoding_utf8, static_cast<unsigned int>( depth ) );
+            }
+        }
     }
 
 
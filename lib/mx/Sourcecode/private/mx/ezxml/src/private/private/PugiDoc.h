@@ -22,6 +22,9 @@ namespace ezxml
         
         virtual void loadStream( std::istream& is ) override;
         virtual void saveStream( std::ostream& os ) const override;
+        virtual void loadBufferInPlace( void* data, std::size_t size ) override;
+        virtual void saveStream( std::ostream& os, const std::string& elementName, const ChildWriter& writeChildren ) const override;
+        virtual void saveFragmentStream( std::ostream& os, int depth ) const override;
         
         virtual void loadFile( const std::string& filename ) override;
         virtual void saveFile( const std::string& filename ) const override;
@@ -54,6 +57,7 @@ namespace ezxml
         bool myIsStandalone;
         bool myDoWriteBom;
         
+        void finishLoad( const pugi::xml_parse_result& parseResult );
         void parseXmlDeclarationValues();
         void parseXmlVersionFromDoc();
         void parseEncodingFromDoc();
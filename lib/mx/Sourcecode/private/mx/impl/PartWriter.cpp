@@ -233,15 +233,40 @@ namespace mx
 
 
         core::PartwisePartPtr PartWriter::getPartwisePart() const
+        {
+            getEmptyPartwisePart();
+            writeMeasures();
+            return myOutPartwisePart;
+        }
+
+
+        core::PartwisePartPtr PartWriter::getEmptyPartwisePart() const
         {
             myOutPartwisePart = core::makePartwisePart();
             auto& attr = *myOutPartwisePart->getAttributes();
             attr.id = core::XsID{ myPartData.uniqueId };
-            writeMeasures();
             return myOutPartwisePart;
         }
         
         void PartWriter::writeMeasures() const
+        {
+            bool isFirstMeasure = true;
+            writeMeasures( [&]( const core::PartwiseMeasurePtr& measure )
+            {
+                myOutPartwisePart->addPartwiseMeasure( measure );
+
+                // the first measure replaces the empty one core put in the part
+                auto& partwiseMeasureSet = myOutPartwisePart->getPartwiseMeasureSet();
+                if( isFirstMeasure && partwiseMeasureSet.size() == 2 )
+                {
+                    myOutPartwisePart->removePartwiseMeasure( partwiseMeasureSet.cbegin() );
+                }
+
+                isFirstMeasure = false;
+            } );
+        }
+
+        void PartWriter::writeMeasures( const MeasureSink& inSink ) const
         {
             if( myPartData.measures.size() == 0 )
             {
@@ -253,16 +278,16 @@ namespace mx
                 {
                     auto copiedPart = myPartData;
                     copiedPart.measures.emplace_back( mx::api::MeasureData{} );
-                    writeMeasures( copiedPart );
+                    writeMeasures( copiedPart, inSink );
                 }
             }
             else
             {
-                writeMeasures( myPartData );
+                writeMeasures( myPartData, inSink );
             }
         }
 
-        void PartWriter::writeMeasures( const mx::api::PartData& inPartData ) const
+        void PartWriter::writeMeasures( const mx::api::PartData& inPartData, const MeasureSink& inSink ) const
         {
             MeasureCursor cursor{ static_cast<int>( inPartData.measures.at( 0 ).staves.size() ), myTicksPerQuarter };
             cursor.measureIndex = 0;
@@ -271,15 +296,13 @@ namespace mx
 
             for( const auto& measure : inPartData.measures )
             {
-                MeasureWriter writer{ measure, cursor, myScoreWriter };
-                myOutPartwisePart->addPartwiseMeasure( writer.getPartwiseMeasure() );
+                // the score isn't copied and sorted as a whole, so only one
+                // measure's worth of copy exists at a time
+                auto sortedMeasure = measure;
+                sortedMeasure.sort();
 
-                auto& partwiseMeasureSet = myOutPartwisePart->getPartwiseMeasureSet();
-
-                if( cursor.measureIndex == 0 && partwiseMeasureSet.size() == 2 )
-                {
-                    myOutPartwisePart->removePartwiseMeasure( partwiseMeasureSet.cbegin() );
-                }
+                MeasureWriter writer{ sortedMeasure, cursor, myScoreWriter };
+                inSink( writer.getPartwiseMeasure() );
 
                 cursor.isFirstMeasureInPart = false;
                 ++cursor.measureIndex;
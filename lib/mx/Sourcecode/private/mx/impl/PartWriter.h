@@ -6,6 +6,7 @@
 
 #include "mx/api/PartData.h"
 
+#include <functional>
 #include <memory>
 #include <mutex>
 
@@ -15,6 +16,8 @@ namespace mx
     {
         class PartwisePart;
         using PartwisePartPtr = std::shared_ptr<PartwisePart>;
+        class PartwiseMeasure;
+        using PartwiseMeasurePtr = std::shared_ptr<PartwiseMeasure>;
         class ScorePart;
         using ScorePartPtr = std::shared_ptr<ScorePart>;
     }
@@ -26,10 +29,20 @@ namespace mx
         class PartWriter
         {
         public:
+            using MeasureSink = std::function<void( const core::PartwiseMeasurePtr& )>;
+
             PartWriter( const api::PartData& inPartData, int inPartIndex, int inTicksPerQuarter, const ScoreWriter& inScoreWriter );
             core::ScorePartPtr getScorePart() const;
             core::PartwisePartPtr getPartwisePart() const;
 
+            /// The part without its measures, i.e. with the single empty
+            /// measure that core gives every part.
+            core::PartwisePartPtr getEmptyPartwisePart() const;
+
+            /// Converts the measures from myPartData one at a time, handing
+            /// each to inSink as soon as it is done.
+            void writeMeasures( const MeasureSink& inSink ) const;
+
         private:
             const api::PartData& myPartData;
             const int myPartIndex;
@@ -43,11 +56,11 @@ namespace mx
             /// Writes all the measures from myPartData to myOutScorePart
             void writeMeasures() const;
 
-            /// Writes all the measures from inPartData to myOutScorePart. We added this function,
+            /// Writes all the measures from inPartData to inSink. We added this function,
             /// in which the part data is passed in, to handle a case when there are zero measures
             /// in myPartData, but we need to force a single measure to exist in the MusicXML to
             /// preserve something about the part.
-            void writeMeasures( const mx::api::PartData& inPartData ) const;
+            void writeMeasures( const mx::api::PartData& inPartData, const MeasureSink& inSink ) const;
         };
     }
 }
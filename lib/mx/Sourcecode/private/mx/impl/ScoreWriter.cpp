@@ -43,10 +43,26 @@ namespace mx
         , myMutex{}
         , myOutScorePartwise{ nullptr }
         {
-            myScoreData.sort();
+
         }
         
         core::ScorePartwisePtr ScoreWriter::getScorePartwise() const
+        {
+            return makeScorePartwise( true );
+        }
+
+        core::ScorePartwisePtr ScoreWriter::getEmptyScorePartwise() const
+        {
+            return makeScorePartwise( false );
+        }
+
+        void ScoreWriter::writeMeasures( int inPartIndex, const PartWriter::MeasureSink& inSink ) const
+        {
+            PartWriter partWriter{ getPart( inPartIndex ), inPartIndex, myScoreData.ticksPerQuarter, *this };
+            partWriter.writeMeasures( inSink );
+        }
+
+        core::ScorePartwisePtr ScoreWriter::makeScorePartwise( bool inWriteMeasures ) const
         {
             std::lock_guard<std::mutex> lock{ myMutex };
             myOutScorePartwise = core::makeScorePartwise();
@@ -131,7 +147,8 @@ namespace mx
             for( const auto& partData : myScoreData.parts )
             {
                 PartWriter partWriter{ partData, partIndex, myScoreData.ticksPerQuarter, *this };
-                partPairs.emplace_back( std::make_pair( partWriter.getScorePart(), partWriter.getPartwisePart() ) );
+                auto partwisePart = inWriteMeasures ? partWriter.getPartwisePart() : partWriter.getEmptyPartwisePart();
+                partPairs.emplace_back( std::make_pair( partWriter.getScorePart(), partwisePart ) );
                 ++partIndex;
             }
             
@@ -6,6 +6,7 @@
 
 #include "mx/api/ScoreData.h"
 #include "mx/impl/Cursor.h"
+#include "mx/impl/PartWriter.h"
 
 #include <mutex>
 #include <optional>
@@ -31,9 +32,17 @@ namespace mx
         class ScoreWriter
         {
         public:
+            /// inScoreData is not copied, it must outlive the writer.
             ScoreWriter( const api::ScoreData& inScoreData );
 
             core::ScorePartwisePtr getScorePartwise() const;
+
+            /// Like getScorePartwise, but each part is left with the single
+            /// empty measure that core gives it. Use writeMeasures to convert
+            /// the real measures one at a time.
+            core::ScorePartwisePtr getEmptyScorePartwise() const;
+            void writeMeasures( int inPartIndex, const PartWriter::MeasureSink& inSink ) const;
+
             inline const api::ScoreData& getScoreData() const { return myScoreData; }
 
             /// Finds the part in ScoreData and returns it. Throws if out-of-range.
@@ -44,11 +53,12 @@ namespace mx
             api::SystemData getSystemData( int measureIndex ) const;
             
         private:
-            api::ScoreData myScoreData;
+            const api::ScoreData& myScoreData;
             mutable std::mutex myMutex;
             mutable core::ScorePartwisePtr myOutScorePartwise;
             
         private:
+            core::ScorePartwisePtr makeScorePartwise( bool inWriteMeasures ) const;
             void addScorePart( int partIndex, const core::ScorePartPtr& scorePart ) const;
             void addPartwisePart( int partIndex, const core::PartwisePartPtr& partwisePart ) const;
             bool partGroupStartExists( int partIndex ) const;
@@ -0,0 +1,256 @@
+#include "mxl_writer.h"
+
+#include "exception.h"
+
+#include <cstdint>
+#include <limits>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <zlib.h>
+
+inline constexpr char mxl_mimetype[]{ "application/vnd.recordare.musicxml" };
+inline constexpr char mxl_score_path[]{ "score.musicxml" };
+
+inline constexpr std::uint16_t zip_version{ 20 }; // 2.0: deflate and data descriptors
+inline constexpr std::uint16_t zip_data_descriptor_flag{ 0x0008 }; // CRC and sizes follow the data
+inline constexpr std::uint16_t zip_stored{ 0 };
+inline constexpr std::uint16_t zip_deflated{ 8 };
+inline constexpr std::uint16_t zip_dos_date{ (1 << 5) | 1 }; // 1980-01-01, so the same score always gives the same file
+
+inline constexpr std::size_t deflate_buffer_bytes{ 64 * 1024 };
+
+// Deflates everything written to it into output, keeping the CRC and both sizes for the zip headers
+class DeflateBuffer : public std::streambuf {
+public:
+	explicit DeflateBuffer(std::ostream& output)
+		: m_output{ output }, m_input(deflate_buffer_bytes), m_compressed(deflate_buffer_bytes) {
+		// Raw deflate (negative window bits): zip has its own headers and checksum
+		if (deflateInit2(&m_stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+			throw Exception{ "Could not start compressing the .mxl file!\n" };
+		}
+		setp(m_input.data(), m_input.data() + m_input.size());
+	}
+
+	~DeflateBuffer() override {
+		deflateEnd(&m_stream);
+	}
+
+	DeflateBuffer(const DeflateBuffer&) = delete;
+	DeflateBuffer& operator=(const DeflateBuffer&) = delete;
+
+	void finish() {
+		compress(Z_FINISH);
+	}
+
+	const std::uint32_t get_crc() const {
+		return static_cast<std::uint32_t>(m_crc);
+	}
+
+	const std::uint64_t get_size() const {
+		return m_size;
+	}
+
+	const std::uint64_t get_compressed_size() const {
+		return m_compressed_size;
+	}
+
+protected:
+	int_type overflow(const int_type c) override {
+		compress(Z_NO_FLUSH);
+		if (!traits_type::eq_int_type(c, traits_type::eof())) {
+			*pptr() = traits_type::to_char_type(c);
+			pbump(1);
+		}
+		return traits_type::not_eof(c);
+	}
+
+private:
+	void compress(const int flush);
+
+	std::ostream& m_output;
+	std::vector<char> m_input;
+	std::vector<char> m_compressed;
+	z_stream m_stream{};
+	uLong m_crc{ crc32(0L, Z_NULL, 0) };
+	std::uint64_t m_size{ 0 };
+	std::uint64_t m_compressed_size{ 0 };
+};
+
+void DeflateBuffer::compress(const int flush) {
+	// Deflates the put area, writes whatever comes out and empties the put area
+	const std::size_t input_size{ static_cast<std::size_t>(pptr() - pbase()) };
+	m_crc = crc32(m_crc, reinterpret_cast<const Bytef*>(pbase()), static_cast<uInt>(input_size));
+	m_size += input_size;
+
+	m_stream.next_in = reinterpret_cast<Bytef*>(pbase());
+	m_stream.avail_in = static_cast<uInt>(input_size);
+	int result{ Z_OK };
+	do {
+		m_stream.next_out = reinterpret_cast<Bytef*>(m_compressed.data());
+		m_stream.avail_out = static_cast<uInt>(m_compressed.size());
+		result = deflate(&m_stream, flush);
+		if (result == Z_STREAM_ERROR) {
+			throw Exception{ "Could not compress the .mxl file!\n" };
+		}
+		const std::size_t compressed_size{ m_compressed.size() - m_stream.avail_out };
+		m_output.write(m_compressed.data(), static_cast<std::streamsize>(compressed_size));
+		m_compressed_size += compressed_size;
+	} while (m_stream.avail_out == 0 || (flush == Z_FINISH && result != Z_STREAM_END));
+
+	setp(m_input.data(), m_input.data() + m_input.size());
+}
+
+// Writes a zip archive front to back. Deflated entries are streamed, with their CRC and sizes in a data
+// descriptor after the data, so the output never has to be sought
+class ZipWriter {
+public:
+	explicit ZipWriter(std::ostream& output)
+		: m_output{ output } {
+	}
+
+	void add_stored(const std::string& name, const std::string& data);
+	void add_deflated(const std::string& name, const std::function<void(std::ostream&)>& write);
+	void finish(); // Writes the central directory
+
+private:
+	struct Entry {
+		std::string name{};
+		std::uint16_t flags{};
+		std::uint16_t method{};
+		std::uint32_t crc{};
+		std::uint32_t compressed_size{};
+		std::uint32_t size{};
+		std::uint32_t offset{};
+	};
+
+	void write_local_header(const Entry& entry);
+	void write_bytes(const char* data, const std::size_t size);
+	void write_u16(const std::uint16_t value);
+	void write_u32(const std::uint32_t value);
+
+	std::ostream& m_output;
+	std::vector<Entry> m_entries{};
+	std::uint64_t m_position{ 0 };
+};
+
+const std::uint32_t to_zip_size(const std::uint64_t size) {
+	if (size > std::numeric_limits<std::uint32_t>::max()) {
+		throw Exception{ "The .mxl file would be over 4 GiB, which needs Zip64. Write .musicxml instead!\n" };
+	}
+	return static_cast<std::uint32_t>(size);
+}
+
+void ZipWriter::add_stored(const std::string& name, const std::string& data) {
+	const std::uint32_t crc{ static_cast<std::uint32_t>(crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef*>(data.data()), static_cast<uInt>(data.size()))) };
+	const std::uint32_t size{ to_zip_size(data.size()) };
+	m_entries.emplace_back(Entry{ name, 0, zip_stored, crc, size, size, to_zip_size(m_position) });
+	write_local_header(m_entries.back());
+	write_bytes(data.data(), data.size());
+}
+
+void ZipWriter::add_deflated(const std::string& name, const std::function<void(std::ostream&)>& write) {
+	Entry entry{ name, zip_data_descriptor_flag, zip_deflated, 0, 0, 0, to_zip_size(m_position) };
+	write_local_header(entry);
+
+	DeflateBuffer buffer{ m_output };
+	std::ostream stream{ &buffer };
+	write(stream);
+	buffer.finish();
+	m_position += buffer.get_compressed_size();
+
+	entry.crc = buffer.get_crc();
+	entry.compressed_size = to_zip_size(buffer.get_compressed_size());
+	entry.size = to_zip_size(buffer.get_size());
+	write_u32(0x08074b50); // Data descriptor
+	write_u32(entry.crc);
+	write_u32(entry.compressed_size);
+	write_u32(entry.size);
+	m_entries.emplace_back(entry);
+}
+
+void ZipWriter::finish() {
+	const std::uint32_t directory_offset{ to_zip_size(m_position) };
+	for (const Entry& entry : m_entries) {
+		write_u32(0x02014b50); // Central directory file header
+		write_u16(zip_version); // Made by
+		write_u16(zip_version); // Needed to extract
+		write_u16(entry.flags);
+		write_u16(entry.method);
+		write_u16(0); // Time
+		write_u16(zip_dos_date);
+		write_u32(entry.crc);
+		write_u32(entry.compressed_size);
+		write_u32(entry.size);
+		write_u16(static_cast<std::uint16_t>(entry.name.size()));
+		write_u16(0); // Extra field length
+		write_u16(0); // Comment length
+		write_u16(0); // Disk number
+		write_u16(0); // Internal attributes
+		write_u32(0); // External attributes
+		write_u32(entry.offset);
+		write_bytes(entry.name.data(), entry.name.size());
+	}
+	const std::uint32_t directory_size{ to_zip_size(m_position - directory_offset) };
+
+	write_u32(0x06054b50); // End of central directory
+	write_u16(0); // This disk
+	write_u16(0); // Disk with the central directory
+	write_u16(static_cast<std::uint16_t>(m_entries.size()));
+	write_u16(static_cast<std::uint16_t>(m_entries.size()));
+	write_u32(directory_size);
+	write_u32(directory_offset);
+	write_u16(0); // Comment length
+}
+
+void ZipWriter::write_local_header(const Entry& entry) {
+	write_u32(0x04034b50);
+	write_u16(zip_version);
+	write_u16(entry.flags);
+	write_u16(entry.method);
+	write_u16(0); // Time
+	write_u16(zip_dos_date);
+	write_u32(entry.crc);
+	write_u32(entry.compressed_size);
+	write_u32(entry.size);
+	write_u16(static_cast<std::uint16_t>(entry.name.size()));
+	write_u16(0); // Extra field length
+	write_bytes(entry.name.data(), entry.name.size());
+}
+
+void ZipWriter::write_bytes(const char* data, const std::size_t size) {
+	m_output.write(data, static_cast<std::streamsize>(size));
+	m_position += size;
+}
+
+void ZipWriter::write_u16(const std::uint16_t value) {
+	const char bytes[]{ static_cast<char>(value & 0xff), static_cast<char>(value >> 8) };
+	write_bytes(bytes, sizeof(bytes));
+}
+
+void ZipWriter::write_u32(const std::uint32_t value) {
+	write_u16(static_cast<std::uint16_t>(value & 0xffff));
+	write_u16(static_cast<std::uint16_t>(value >> 16));
+}
+
+void write_mxl(std::ostream& output, const std::function<void(std::ostream&)>& write_score) {
+	const std::string container{
+		"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<container>\n"
+		"  <rootfiles>\n"
+		"    <rootfile full-path=\"" + std::string{ mxl_score_path } + "\" media-type=\"application/vnd.recordare.musicxml+xml\"/>\n"
+		"  </rootfiles>\n"
+		"</container>\n" };
+
+	ZipWriter zip{ output };
+	zip.add_stored("mimetype", mxl_mimetype); // Must come first, uncompressed
+	zip.add_deflated("META-INF/container.xml", [&](std::ostream& stream) {
+		stream << container;
+	});
+	zip.add_deflated(mxl_score_path, write_score);
+	zip.finish();
+
+	if (!output) {
+		throw Exception{ "Could not write the .mxl file!\n" };
+	}
+}
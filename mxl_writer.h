@@ -0,0 +1,9 @@
+#pragma once
+
+#include <functional>
+#include <ostream>
+
+// Writes compressed MusicXML (.mxl): a zip archive holding the mimetype, META-INF/container.xml and the score.
+// Whatever write_score writes is deflated as it arrives, so the uncompressed MusicXML is never held in full and
+// never touches the disk. output must be opened in binary mode; it's only written to, never sought
+void write_mxl(std::ostream& output, const std::function<void(std::ostream&)>& write_score);
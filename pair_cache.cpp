@@ -0,0 +1,75 @@
+#include "pair_cache.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+const std::size_t VoicePairKeyHash::operator()(const VoicePairKey& key) const {
+	// h_shifts are tick counts and v_shifts are -6..6, so this packing doesn't collide in practice
+	const std::uint64_t packed{
+		(static_cast<std::uint64_t>(static_cast<std::uint32_t>(key.first.h_shift)) << 40)
+		^ (static_cast<std::uint64_t>(static_cast<std::uint32_t>(key.second.h_shift)) << 16)
+		^ (static_cast<std::uint64_t>(key.first.v_shift + 8) << 8)
+		^ (static_cast<std::uint64_t>(key.second.v_shift + 8) << 3)
+		^ static_cast<std::uint64_t>(key.voice_count_class)
+	};
+	return std::hash<std::uint64_t>{}(packed);
+}
+
+const VoicePairKey make_voice_pair_key(const Shift& first, const Shift& second, const std::size_t voice_count) {
+	return VoicePairKey{ first, second, static_cast<int>(std::min<std::size_t>(voice_count, 4)) };
+}
+
+const VoicePairResult* PairCache::find(const VoicePairKey& key) const {
+	const std::shared_lock<std::shared_mutex> lock{ m_mutex };
+	const auto result{ m_results.find(key) };
+	return (result == m_results.end()) ? nullptr : &result->second;
+}
+
+const VoicePairResult* PairCache::insert(const VoicePairKey& key, const VoicePairResult& result) {
+	const std::unique_lock<std::shared_mutex> lock{ m_mutex };
+	return &m_results.try_emplace(key, result).first->second; // If another thread got there first, both results are identical anyway
+}
+
+const VoicePairRoles* PairCache::find_roles(const VoicePairKey& key) const {
+	const std::shared_lock<std::shared_mutex> lock{ m_mutex };
+	const auto roles{ m_roles.find(key) };
+	return (roles == m_roles.end()) ? nullptr : &roles->second;
+}
+
+void PairCache::insert_roles(const VoicePairKey& key, const VoicePairRoles& roles) {
+	const std::unique_lock<std::shared_mutex> lock{ m_mutex };
+	m_roles.try_emplace(key, roles);
+}
+
+void RejectionCounts::record(const std::pair<int, int>& voice_pair) {
+	if (voice_pair.first < max_counted_voices && voice_pair.second < max_counted_voices) {
+		m_counts.at(voice_pair.first * max_counted_voices + voice_pair.second).fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+const std::uint64_t RejectionCounts::get(const std::pair<int, int>& voice_pair) const {
+	if (voice_pair.first < max_counted_voices && voice_pair.second < max_counted_voices) {
+		return m_counts.at(voice_pair.first * max_counted_voices + voice_pair.second).load(std::memory_order_relaxed);
+	}
+	return 0;
+}
+
+void RejectionCounts::sort_by_rejections(std::pmr::vector<std::pair<int, int>>& voice_pairs) const {
+	// Counts are read once up front, since other threads keep incrementing them while this sorts
+	std::pmr::vector<std::pair<std::uint64_t, std::pair<int, int>>> counted_pairs{ voice_pairs.get_allocator().resource() };
+	counted_pairs.reserve(voice_pairs.size());
+	for (const std::pair<int, int>& voice_pair : voice_pairs) {
+		counted_pairs.emplace_back(get(voice_pair), voice_pair);
+	}
+	// Insertion sort: stable like std::stable_sort, without its temporary buffer, and there are only a few dozen pairs
+	for (std::size_t i{ 1 }; i < counted_pairs.size(); ++i) {
+		for (std::size_t j{ i }; j > 0 && counted_pairs[j - 1].first < counted_pairs[j].first; --j) {
+			std::swap(counted_pairs[j - 1], counted_pairs[j]);
+		}
+	}
+	for (std::size_t i{ 0 }; i < voice_pairs.size(); ++i) {
+		voice_pairs.at(i) = counted_pairs.at(i).second;
+	}
+}
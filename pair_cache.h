@@ -0,0 +1,89 @@
+#pragma once
+
+#include "canon.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+#include <shared_mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Whether one pair of voices has a valid inversion. Every voice is the leader moved by its Shift, and
+// padding only adds rests at the end of both voices, so the verdict only depends on the two shifts and on
+// which voice-count rules apply.
+struct VoicePairResult {
+	bool sa_21_valid{};
+	bool sa_12_valid{};
+	std::vector<Message> error_message_box{}; // Only filled if neither inversion is valid
+	std::vector<Message> warning_message_box{}; // Warnings of the inversion that ends up in the canon
+
+	// Simultaneous dissonances are checked against the dissonances of the pairs checked before this one. A
+	// cached result is only reused if none of the ticks it looked up were marked by another pair.
+	std::vector<int> dissonance_ticks_read{};
+	std::vector<int> dissonance_ticks_written{};
+};
+
+// Which roles the valid inversions of one pair of voices rule out. Only worked out for canons where every
+// pair has a valid inversion, against the dissonances of the pairs before this one and of this pair.
+struct VoicePairRoles {
+	bool invalid_bass_2{}; // Voice 2 can't be the bass
+	bool invalid_top_1{};
+	bool invalid_bass_1{};
+	bool invalid_top_2{};
+	bool invalid_outer_21{}; // Voice 2 in the bass, voice 1 on top
+	bool invalid_outer_12{};
+
+	std::vector<int> dissonance_ticks_read{}; // Reused like VoicePairResult, if the pair's VoicePairResult can be reused too
+};
+
+struct VoicePairKey {
+	Shift first{};
+	Shift second{};
+	int voice_count_class{}; // 2, 3 or 4 (4 or more). The rules don't tell larger textures apart
+
+	const bool operator==(const VoicePairKey& other) const {
+		return first == other.first && second == other.second && voice_count_class == other.voice_count_class;
+	}
+};
+
+struct VoicePairKeyHash {
+	const std::size_t operator()(const VoicePairKey& key) const;
+};
+
+const VoicePairKey make_voice_pair_key(const Shift& first, const Shift& second, const std::size_t voice_count);
+
+// How often each pair of texture positions has disqualified a canon so far. check_counterpoint tries the
+// pairs that fail most often first, so most rejected candidates only need one or two pair verdicts.
+class RejectionCounts {
+public:
+	static constexpr int max_counted_voices{ 16 }; // Pairs with a voice past this are never counted and go last
+
+	void record(const std::pair<int, int>& voice_pair);
+	const std::uint64_t get(const std::pair<int, int>& voice_pair) const;
+	void sort_by_rejections(std::pmr::vector<std::pair<int, int>>& voice_pairs) const; // Most rejections first, stable. Scratch goes to the vector's memory resource
+
+private:
+	std::array<std::atomic<std::uint64_t>, max_counted_voices * max_counted_voices> m_counts{};
+};
+
+// Shared by every candidate (and every thread) of one run. Results are never erased, so the pointers
+// returned by find() and insert() stay valid for the lifetime of the cache.
+class PairCache {
+public:
+	const VoicePairResult* find(const VoicePairKey& key) const;
+	const VoicePairResult* insert(const VoicePairKey& key, const VoicePairResult& result); // Returns the cached result
+	const VoicePairRoles* find_roles(const VoicePairKey& key) const;
+	void insert_roles(const VoicePairKey& key, const VoicePairRoles& roles);
+
+	RejectionCounts& rejection_counts() { return m_rejection_counts; }
+
+private:
+	mutable std::shared_mutex m_mutex{};
+	std::unordered_map<VoicePairKey, VoicePairResult, VoicePairKeyHash> m_results{};
+	std::unordered_map<VoicePairKey, VoicePairRoles, VoicePairKeyHash> m_roles{};
+	RejectionCounts m_rejection_counts{};
+};
@@ -0,0 +1,151 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+const int hardware_threads() {
+	const unsigned int count{ std::thread::hardware_concurrency() };
+	return (count == 0) ? 1 : static_cast<int>(count); // hardware_concurrency() is allowed to return 0 if unknown
+}
+
+const int resolve_thread_count(const int requested_threads) {
+	return (requested_threads <= 0) ? hardware_threads() : requested_threads;
+}
+
+// One parallel_for call. Lives on the caller's stack; the pool only touches it while it's queued or helped
+struct ParallelJob {
+	const std::function<void(const std::size_t)>& body;
+	const std::size_t count;
+	std::size_t helper_slots; // Pool threads that may still join. Guarded by the pool mutex
+	std::size_t active_helpers{ 0 }; // Guarded by the pool mutex
+	std::atomic<std::size_t> next_index{ 0 };
+	std::exception_ptr first_exception{};
+	std::mutex exception_mutex{};
+
+	ParallelJob(const std::function<void(const std::size_t)>& job_body, const std::size_t job_count, const std::size_t helpers)
+		: body{ job_body }, count{ job_count }, helper_slots{ helpers } {
+	}
+
+	void run_items() {
+		// Every worker grabs the next unclaimed index, so slow items (long canons, many voices) don't hold up a fixed chunk
+		while (true) {
+			const std::size_t i{ next_index.fetch_add(1) };
+			if (i >= count) {
+				return;
+			}
+
+			try {
+				body(i);
+			}
+			catch (...) {
+				const std::lock_guard<std::mutex> lock{ exception_mutex };
+				if (!first_exception) {
+					first_exception = std::current_exception();
+				}
+				next_index = count; // Stop handing out work
+			}
+		}
+	}
+};
+
+// Threads that outlive parallel_for calls. The recursive searches call parallel_for for every h_shift of every
+// canon they extend, so starting threads per call cost more than the checks, and each new thread started with an
+// empty scratch arena. The pool grows to the most helpers any call has asked for and is joined at exit
+class ThreadPool {
+public:
+	ThreadPool() = default;
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	~ThreadPool() {
+		{
+			const std::lock_guard<std::mutex> lock{ m_mutex };
+			m_stopping = true;
+		}
+		m_work_ready.notify_all();
+		for (std::thread& thread : m_threads) {
+			thread.join();
+		}
+	}
+
+	void run(ParallelJob& job) {
+		std::unique_lock<std::mutex> lock{ m_mutex };
+		while (m_threads.size() < job.helper_slots) {
+			m_threads.emplace_back([this]() { work(); });
+		}
+		m_jobs.emplace_back(&job);
+		lock.unlock();
+		m_work_ready.notify_all();
+
+		job.run_items(); // Calling thread does its share too. It may itself be a pool thread (nested calls)
+
+		// Items left are already claimed. Stop more helpers joining, then wait for the ones running
+		lock.lock();
+		const auto queued{ std::find(m_jobs.begin(), m_jobs.end(), &job) };
+		if (queued != m_jobs.end()) {
+			m_jobs.erase(queued);
+		}
+		m_job_done.wait(lock, [&]() { return job.active_helpers == 0; });
+	}
+
+private:
+	void work() {
+		std::unique_lock<std::mutex> lock{ m_mutex };
+		while (true) {
+			m_work_ready.wait(lock, [this]() { return m_stopping || !m_jobs.empty(); });
+			if (m_stopping) {
+				return;
+			}
+
+			ParallelJob& job{ *m_jobs.front() };
+			if (--job.helper_slots == 0) {
+				m_jobs.pop_front();
+			}
+			++job.active_helpers;
+			lock.unlock();
+
+			job.run_items();
+
+			lock.lock();
+			if (--job.active_helpers == 0) {
+				m_job_done.notify_all();
+			}
+		}
+	}
+
+	std::mutex m_mutex{};
+	std::condition_variable m_work_ready{};
+	std::condition_variable m_job_done{};
+	std::deque<ParallelJob*> m_jobs{}; // Jobs that can take another helper
+	std::vector<std::thread> m_threads{};
+	bool m_stopping{ false };
+};
+
+ThreadPool& get_thread_pool() {
+	static ThreadPool pool{};
+	return pool;
+}
+
+void parallel_for(const std::size_t count, const int threads, const std::function<void(const std::size_t)>& body) {
+	const std::size_t worker_count{ std::min(count, static_cast<std::size_t>(resolve_thread_count(threads))) };
+
+	if (worker_count <= 1) {
+		for (std::size_t i{ 0 }; i < count; ++i) {
+			body(i);
+		}
+		return;
+	}
+
+	ParallelJob job{ body, count, worker_count - 1 };
+	get_thread_pool().run(job);
+
+	if (job.first_exception) {
+		std::rethrow_exception(job.first_exception);
+	}
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+const int hardware_threads();
+const int resolve_thread_count(const int requested_threads); // 0 = one per hardware thread
+
+// Runs body(0) ... body(count - 1) on up to `threads` workers: the calling thread and threads from a pool that
+// persists between calls. Items are handed out one at a time, so the order they run in is unspecified; callers
+// that need ordered output should write into slot `i`. body may call parallel_for itself.
+void parallel_for(const std::size_t count, const int threads, const std::function<void(const std::size_t)>& body);
@@ -0,0 +1,35 @@
+#include "scratch_arena.h"
+
+#include <algorithm>
+#include <cstdint>
+
+void* ScratchArena::do_allocate(const std::size_t bytes, const std::size_t alignment) {
+	while (true) {
+		if (m_block < m_blocks.size()) {
+			const Block& block{ m_blocks.at(m_block) };
+			const std::uintptr_t start{ reinterpret_cast<std::uintptr_t>(block.data.get()) };
+			const std::uintptr_t aligned{ (start + m_offset + alignment - 1) / alignment * alignment };
+			const std::size_t end{ static_cast<std::size_t>(aligned - start) + bytes };
+			if (end <= block.size) {
+				m_offset = end;
+				return reinterpret_cast<void*>(aligned);
+			}
+
+			// Doesn't fit. Later blocks are at least as large, so try the next one
+			++m_block;
+			m_offset = 0;
+			continue;
+		}
+
+		// Out of blocks. Grow geometrically so a large voice pair only costs a few allocations, once
+		const std::size_t size{ std::max({ first_block_bytes, bytes + alignment, m_blocks.empty() ? std::size_t{ 0 } : 2 * m_blocks.back().size }) };
+		m_blocks.emplace_back(Block{ std::make_unique<std::byte[]>(size), size });
+		m_block = m_blocks.size() - 1;
+		m_offset = 0;
+	}
+}
+
+ScratchArena& get_scratch_arena() {
+	thread_local ScratchArena arena{};
+	return arena;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <memory_resource>
+#include <vector>
+
+// Bump allocator for the checker's scratch data (sonority arrays, index arrays, message boxes...). deallocate()
+// does nothing: memory comes back all at once when the ScratchScope that was open at allocation time closes.
+// Blocks are kept for the next scope, so once a thread has seen its largest voice pair the checker stops
+// calling malloc for scratch data. Not thread safe; every thread has its own (get_scratch_arena())
+class ScratchArena : public std::pmr::memory_resource {
+public:
+	struct Position {
+		std::size_t block{};
+		std::size_t offset{};
+	};
+
+	ScratchArena() = default;
+	ScratchArena(const ScratchArena&) = delete;
+	ScratchArena& operator=(const ScratchArena&) = delete;
+
+	const Position get_position() const {
+		return Position{ m_block, m_offset };
+	}
+
+	void rewind(const Position& position) {
+		m_block = position.block;
+		m_offset = position.offset;
+	}
+
+private:
+	struct Block {
+		std::unique_ptr<std::byte[]> data{};
+		std::size_t size{};
+	};
+
+	static constexpr std::size_t first_block_bytes{ 64 * 1024 };
+
+	void* do_allocate(const std::size_t bytes, const std::size_t alignment) override;
+	void do_deallocate(void*, const std::size_t, const std::size_t) override {
+	}
+	bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+		return this == &other;
+	}
+
+	std::vector<Block> m_blocks{};
+	std::size_t m_block{ 0 }; // Block the next allocation tries first
+	std::size_t m_offset{ 0 }; // Bytes used in m_block
+};
+
+ScratchArena& get_scratch_arena(); // The calling thread's arena
+
+// Releases everything allocated from the thread's arena while it was open. Scopes nest, so check_voice_pair
+// can open one inside check_counterpoint's. Scratch containers must be destroyed before their scope closes
+// (so declare the scope first) and must not grow while a nested scope is open
+class ScratchScope {
+public:
+	ScratchScope()
+		: m_arena{ get_scratch_arena() }, m_position{ m_arena.get_position() } {
+	}
+
+	~ScratchScope() {
+		m_arena.rewind(m_position);
+	}
+
+	ScratchScope(const ScratchScope&) = delete;
+	ScratchScope& operator=(const ScratchScope&) = delete;
+
+	std::pmr::memory_resource* get_resource() {
+		return &m_arena;
+	}
+
+private:
+	ScratchArena& m_arena;
+	const ScratchArena::Position m_position;
+};
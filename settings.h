@@ -25,23 +25,37 @@
 struct Settings {
 	std::string input_file{ "C:/Users/spagh/Desktop/brain rot/C++/canon_generator/input.musicxml" };
 	std::string output_file{ "C:/Users/spagh/Desktop/brain rot/C++/canon_generator/output.musicxml" };
+	std::string batch_input{}; // Directory or list of input files. If set, output_file is a directory
+	std::string batch_extension{ ".musicxml" }; // Of the batch outputs. ".mxl" writes compressed MusicXML
+	int canons_per_file{ 0 }; // Write numbered output files of this many canons as they are found. 0 = one file at the end
+	bool serve{ false }; // Answer requests on stdin/stdout instead of reading input_file
 	bool minor_key{ false };
 	int max_voices{ 5 };
 	int h_shift_increments_per_beat{ 1 };
 	double h_shift_limit{ 0.8 };
 	int measures_separation_between_output_canons{ 0 };
 	std::size_t warning_threshold{ 3 };
+	int threads{ 1 }; // 0 = one per hardware thread
+	bool depth_first{ false }; // Extend one canon at a time instead of building every canon of a voice count first
+	std::string stats_file{}; // If set, rule hit counts, stage times and candidates per second are written here as JSON at the end of the run
 };
 
 const std::string help_message{
 	"-i / --input: string, input file path\n"
-	"-o / --output: string, output file path\n"
+	"-o / --output: string, output file path (output directory with --batch)\n"
+	"-b / --batch: string, directory of MusicXML files or text file with one input path per line\n"
+	"-e / --extension: string, extension of the --batch outputs, .musicxml or .mxl (default .musicxml)\n"
+	"-f / --canons-per-file: integer, write numbered output files of this many canons as they are found (0 = one file at the end)\n"
+	"-S / --serve: true/false, answer requests on stdin/stdout (see serve() for the protocol)\n"
 	"-m / --minor: true/false, whether key is minor\n"
 	"-v / --voices: integer, max number of voices & number of staves\n"
 	"-n / --shift-increment: integer, reciprocal of minimum increment of shift in beats\n"
 	"-l / --shift-limit: decimal, maximum shift as a proportion of total leader length\n"
 	"-s / --separation: integer, measures of separation between canons\n"
 	"-w / --warning: integer, maximum number of warnings allowed\n"
+	"-t / --threads: integer, worker threads for the shift search (0 = all cores)\n"
+	"-d / --depth-first: true/false, search one canon at a time to save memory (same canons, in a different order)\n"
+	"-j / --stats: string, write rule hit counts, stage times and candidates per second to this JSON file at the end of the run\n"
 	"-h / --help: help\n"
 };
 
@@ -1,81 +1,83 @@
 #include "mx/api/ScoreData.h"
 
 #include "sonority.h"
+#include "interval_kernel.h"
 
-Sonority::Sonority(const mx::api::NoteData& note_1, const mx::api::NoteData& note_2, const int rhythmic_hierarchy, const int id)
+#include <algorithm>
+#include <cstdlib>
+
+Sonority::Sonority(const CompactNote& note_1, const CompactNote& note_2, const int rhythmic_hierarchy, const int id)
 	: m_note_1{ note_1 }, m_note_2{ note_2 }, m_rhythmic_hierarchy{ rhythmic_hierarchy }, m_index{ id } {
-	//m_compound_interval = get_interval(m_note_1, m_note_2, false);
-	//m_simple_interval = m_compound_interval;
+	update_intervals();
 }
 
-const bool Sonority::is_sonority_dissonant(const std::pair<std::vector<int>, std::vector<int>>& dissonant_intervals) const {
-	// <scale degrees, semitones>
-	return is_dissonant(m_note_1, m_note_2, dissonant_intervals);
-}
+void Sonority::update_intervals() {
+	// The rules ask for these over and over, so work them out once per sonority
+	m_signed_compound_interval = get_interval(m_note_1, m_note_2, true);
+	if (get_num_rests() > 0) {
+		m_compound_interval = m_signed_compound_interval; // Keep the rest code
+		m_simple_interval = m_signed_compound_interval;
+		return;
+	}
 
-void Sonority::build_motion_data(Sonority& next_sonority) {
-	m_note_1_motion = get_interval(get_note_1(), next_sonority.get_note_1(), true); // Don't care about tritone leaps
-	m_note_2_motion = get_interval(get_note_2(), next_sonority.get_note_2(), true);
+	m_compound_interval = Interval{ std::abs(m_signed_compound_interval.first), std::abs(m_signed_compound_interval.second) };
+	m_simple_interval = Interval{ m_compound_interval.first % 7, m_compound_interval.second % 12 };
 }
 
-const MotionType Sonority::get_motion_type() const {
-	const int note_1_motion_type{ (m_note_1_motion.second > 0) ? 1 : ((m_note_1_motion.second < 0) ? -1 : 0) };
-	const int note_2_motion_type{ (m_note_2_motion.second > 0) ? 1 : ((m_note_2_motion.second < 0) ? -1 : 0) };
-	if (note_1_motion_type == note_2_motion_type) {
-		if (note_1_motion_type == 0) {
-			return stationary;
-		}
-		else {
-			return similar;
-		}
+void Sonority::shift_note_octave(const int voice, const int octaves) {
+	if (voice == 0) {
+		m_note_1.shift_octave(octaves);
+	} else
+	if (voice == 1) {
+		m_note_2.shift_octave(octaves);
 	}
 	else {
-		if (note_1_motion_type == 0 || note_2_motion_type == 0) {
-			return oblique;
-		}
-		else {
-			return contrary;
-		}
+		throw Exception("Invalid voice index!");
 	}
+	update_intervals();
+}
+
+const bool Sonority::is_sonority_dissonant(const DissonantIntervals& dissonant_intervals) const {
+	if (get_num_rests() > 0) {
+		return false;
+	}
+
+	return dissonant_intervals.contains(m_simple_interval);
+}
+
+void Sonority::set_intervals(const Interval& signed_compound_interval, const Interval& compound_interval, const Interval& simple_interval) {
+	m_signed_compound_interval = signed_compound_interval;
+	m_compound_interval = compound_interval;
+	m_simple_interval = simple_interval;
+}
+
+void Sonority::set_motion_data(const Interval& note_1_motion, const Interval& note_2_motion, const MotionType motion_type) {
+	m_note_1_motion = note_1_motion;
+	m_note_2_motion = note_2_motion;
+	m_motion_type = motion_type;
 }
 
 const int Sonority::get_num_rests() const {
 	int rests{ 0 };
-	if (m_note_1.isRest) {
+	if (m_note_1.is_rest()) {
 		++rests;
 	}
-	if (m_note_2.isRest) {
+	if (m_note_2.is_rest()) {
 		++rests;
 	}
 	return rests;
 }
 
-const Interval get_interval(const mx::api::NoteData& note_1, const mx::api::NoteData& note_2, const bool number_signed) {
+const Interval get_interval(const CompactNote& note_1, const CompactNote& note_2, const bool number_signed) {
 	// <int, int>---<scale degree interval, semitone interval>
 	// If signed, note_2 higher = positive
 	// Returns compound interval
 
-	if (note_1.isRest || note_2.isRest) {
+	if (note_1.is_rest() || note_2.is_rest()) {
 		return { -1000, -1000 }; // -1000 = rest code
 	}
 
-	const int octave_difference{ note_2.pitchData.octave - note_1.pitchData.octave };
-	const int scale_degree_interval{ static_cast<int>(note_2.pitchData.step) - static_cast<int>(note_1.pitchData.step) + 7 * octave_difference };
-
-	// Check for tritones
-	const std::map<mx::api::Step, int> semitones{ // Map each white note to a number, use alter to increment the number
-		{ mx::api::Step::c, 0 },
-		{ mx::api::Step::d, 2 },
-		{ mx::api::Step::e, 4 },
-		{ mx::api::Step::f, 5 },
-		{ mx::api::Step::g, 7 },
-		{ mx::api::Step::a, 9 },
-		{ mx::api::Step::b, 11 },
-	};
-	const int note_1_semitones{ semitones.at(note_1.pitchData.step) + note_1.pitchData.alter }; // Add 12 to avoid negative values (C flat)
-	const int note_2_semitones{ semitones.at(note_2.pitchData.step) + note_2.pitchData.alter };
-	const int semitone_interval{ note_2_semitones - note_1_semitones + 12 * octave_difference };
-	const Interval output{ scale_degree_interval, semitone_interval };
+	const Interval output{ note_2.get_diatonic_index() - note_1.get_diatonic_index(), note_2.get_semitone_index() - note_1.get_semitone_index() };
 
 	if (number_signed) {
 		return output;
@@ -85,15 +87,13 @@ const Interval get_interval(const mx::api::NoteData& note_1, const mx::api::Note
 	}
 }
 
-const bool is_dissonant(const mx::api::NoteData& note_1, const mx::api::NoteData& note_2,
-	const std::pair<std::vector<int>, std::vector<int>>& dissonant_intervals) {
-	// <scale degrees, semitones>
+const bool is_dissonant(const CompactNote& note_1, const CompactNote& note_2, const DissonantIntervals& dissonant_intervals) {
 
 	// Exempt augmented unisons since raised/lowered leading tones are weird and glitchy
 	// || (simple_interval.second % 12 == 6)
 	// Treat the Aug 4 and Dim 5 as consonant if not involving bass.
 
-	if (note_1.isRest || note_2.isRest) {
+	if (note_1.is_rest() || note_2.is_rest()) {
 		return false;
 	}
 
@@ -101,17 +101,103 @@ const bool is_dissonant(const mx::api::NoteData& note_1, const mx::api::NoteData
 	simple_interval.first %= 7;
 	simple_interval.second %= 12;
 
-	if (std::find(dissonant_intervals.first.begin(), dissonant_intervals.first.end(), simple_interval.first) != dissonant_intervals.first.end()
-		|| std::find(dissonant_intervals.second.begin(), dissonant_intervals.second.end(), simple_interval.second) != dissonant_intervals.second.end()) {
-		// Find in parameter list
-		return true;
+	return dissonant_intervals.contains(simple_interval);
+}
+
+SonorityMasks::SonorityMasks(const SonorityArray& sonority_array, const std::vector<DissonantIntervals>& dissonance_configurations)
+	: m_dissonance_configurations{ dissonance_configurations },
+	m_dissonant(dissonance_configurations.size(), Bitset(bitset_words(sonority_array.size()))),
+	m_perfect_consonances(bitset_words(sonority_array.size())),
+	m_rests(bitset_words(sonority_array.size())) {
+	// Words are assembled in registers and stored once, instead of a read-modify-write per bit
+	for (std::size_t word{ 0 }; word < m_rests.size(); ++word) {
+		const std::size_t first{ 64 * word };
+		const std::size_t last{ std::min(first + 64, sonority_array.size()) };
+
+		std::uint64_t rests{ 0 };
+		std::uint64_t perfect_consonances{ 0 };
+		for (std::size_t i{ first }; i < last; ++i) {
+			const Sonority& sonority{ sonority_array[i] };
+			const std::uint64_t bit{ std::uint64_t{ 1 } << (i - first) };
+			const int semitones{ sonority.get_simple_interval().second };
+			rests |= (sonority.get_num_rests() > 0) ? bit : 0;
+			perfect_consonances |= (sonority.get_num_rests() == 0 && (semitones == 0 || semitones == 7)) ? bit : 0;
+		}
+		m_rests.at(word) = rests;
+		m_perfect_consonances.at(word) = perfect_consonances;
+
+		for (std::size_t configuration{ 0 }; configuration < m_dissonance_configurations.size(); ++configuration) {
+			const DissonantIntervals& dissonant_intervals{ m_dissonance_configurations.at(configuration) };
+			std::uint64_t dissonant{ 0 };
+			for (std::size_t i{ first }; i < last; ++i) {
+				dissonant |= dissonant_intervals.contains(sonority_array[i].get_simple_interval()) ? (std::uint64_t{ 1 } << (i - first)) : 0;
+			}
+			m_dissonant.at(configuration).at(word) = dissonant & ~rests;
+		}
 	}
+}
 
-	return false;
+const Bitset& SonorityMasks::get_dissonant(const DissonantIntervals& dissonant_intervals) const {
+	for (std::size_t configuration{ 0 }; configuration < m_dissonance_configurations.size(); ++configuration) {
+		if (m_dissonance_configurations.at(configuration) == dissonant_intervals) {
+			return m_dissonant.at(configuration);
+		}
+	}
+	throw Exception("Dissonance configuration has no mask!");
 }
 
 const bool is_identical(const Sonority& sonority_1, const Sonority& sonority_2) {
-	const bool note_1_identical{ (sonority_1.get_note_1().pitchData == sonority_2.get_note_1().pitchData) && (sonority_1.get_note_1().isRest == sonority_2.get_note_1().isRest) };
-	const bool note_2_identical{ (sonority_1.get_note_2().pitchData == sonority_2.get_note_2().pitchData) && (sonority_1.get_note_2().isRest == sonority_2.get_note_2().isRest) };
+	const bool note_1_identical{ sonority_1.get_note_1().is_same_pitch(sonority_2.get_note_1()) && (sonority_1.get_note_1().is_rest() == sonority_2.get_note_1().is_rest()) };
+	const bool note_2_identical{ sonority_1.get_note_2().is_same_pitch(sonority_2.get_note_2()) && (sonority_1.get_note_2().is_rest() == sonority_2.get_note_2().is_rest()) };
 	return note_1_identical && note_2_identical;
-}
\ No newline at end of file
+}
+
+static_assert(contrary == 0 && oblique == 1 && similar == 2 && stationary == 3, "The interval kernel writes MotionType values");
+
+const VoiceColumns get_voice_columns(const SonorityArray& sonority_array, const int voice) {
+	VoiceColumns columns{ sonority_array.size(), sonority_array.get_allocator().resource() };
+	for (std::size_t i{ 0 }; i < sonority_array.size(); ++i) {
+		const CompactNote& note{ sonority_array[i].get_note(voice) };
+		columns.diatonic_indices[i] = static_cast<std::int16_t>(note.get_diatonic_index());
+		columns.semitone_indices[i] = static_cast<std::int16_t>(note.get_semitone_index());
+		columns.rest_masks[i] = note.is_rest() ? -1 : 0;
+	}
+	return columns;
+}
+
+void build_interval_data(SonorityArray& sonority_array) {
+	IntervalColumns intervals{ sonority_array.get_allocator().resource() };
+	compute_intervals(get_voice_columns(sonority_array, 0), get_voice_columns(sonority_array, 1), intervals);
+	for (std::size_t i{ 0 }; i < sonority_array.size(); ++i) {
+		sonority_array[i].set_intervals(Interval{ intervals.signed_diatonic[i], intervals.signed_semitones[i] },
+			Interval{ intervals.compound_diatonic[i], intervals.compound_semitones[i] },
+			Interval{ intervals.simple_diatonic[i], intervals.simple_semitones[i] });
+	}
+}
+
+void build_motion_data(SonorityArray& sonority_array) {
+	// Don't care about tritone leaps
+	MotionColumns motions{ sonority_array.get_allocator().resource() };
+	compute_motions(get_voice_columns(sonority_array, 0), get_voice_columns(sonority_array, 1), motions);
+	for (std::size_t i{ 0 }; i < sonority_array.size(); ++i) {
+		sonority_array[i].set_motion_data(Interval{ motions.voice_1_diatonic[i], motions.voice_1_semitones[i] },
+			Interval{ motions.voice_2_diatonic[i], motions.voice_2_semitones[i] },
+			static_cast<MotionType>(motions.motion_types[i]));
+	}
+}
+
+void shift_voice_octave(SonorityArray& sonority_array, const int voice, const int octaves) {
+	// Shifting a whole voice doesn't change its motion, only the intervals, which are rebuilt together afterwards
+	for (Sonority& sonority : sonority_array) {
+		if (voice == 0) {
+			sonority.m_note_1.shift_octave(octaves);
+		} else
+		if (voice == 1) {
+			sonority.m_note_2.shift_octave(octaves);
+		}
+		else {
+			throw Exception("Invalid voice index!");
+		}
+	}
+	build_interval_data(sonority_array);
+}
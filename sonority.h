@@ -1,11 +1,47 @@
 #pragma once
 
 #include "exception.h"
+#include "compact_note.h"
+#include "bitset.h"
 
 #include "mx/api/ScoreData.h"
 
+#include <cstdint>
+#include <initializer_list>
+#include <memory_resource>
+#include <vector>
+
 using Interval = std::pair<int, int>;
 
+// Simple intervals that count as dissonant. Bit n of scale_degrees is the simple interval n (0 = unison,
+// 6 = seventh) and bit n of semitones is n semitones, so a lookup is one AND instead of two list searches
+struct DissonantIntervals {
+	std::uint8_t scale_degrees{};
+	std::uint16_t semitones{};
+
+	constexpr DissonantIntervals(const std::initializer_list<int> scale_degree_list, const std::initializer_list<int> semitone_list) {
+		for (const int scale_degree : scale_degree_list) {
+			scale_degrees |= static_cast<std::uint8_t>(1 << scale_degree);
+		}
+		for (const int semitone : semitone_list) {
+			semitones |= static_cast<std::uint16_t>(1 << semitone);
+		}
+	}
+
+	constexpr bool contains(const Interval& simple_interval) const {
+		// False for the rest code
+		return (simple_interval.first >= 0 && simple_interval.first < 7 && ((scale_degrees >> simple_interval.first) & 1))
+			|| (simple_interval.second >= 0 && simple_interval.second < 12 && ((semitones >> simple_interval.second) & 1));
+	}
+
+	constexpr bool operator==(const DissonantIntervals& other) const {
+		return scale_degrees == other.scale_degrees && semitones == other.semitones;
+	}
+};
+
+inline constexpr DissonantIntervals default_dissonant_intervals{ { 1, 6 }, {} }; // 2nds and 7ths
+inline constexpr DissonantIntervals bass_dissonant_intervals{ { 1, 3, 6 }, { 6 } }; // Also 4ths and tritones against the bass
+
 enum MotionType {
 	contrary,
 	oblique,
@@ -13,39 +49,34 @@ enum MotionType {
 	stationary
 };
 
-const Interval get_interval(const mx::api::NoteData& note_1, const mx::api::NoteData& note_2, const bool number_signed);
+const Interval get_interval(const CompactNote& note_1, const CompactNote& note_2, const bool number_signed);
 
 class Sonority {
 public:
-	Sonority::Sonority(const mx::api::NoteData& note_1, const mx::api::NoteData& note_2, const int rhythmic_hierarchy, const int index);
+	Sonority(const CompactNote& note_1, const CompactNote& note_2, const int rhythmic_hierarchy, const int index);
 
-	const bool Sonority::is_sonority_dissonant(const std::pair<std::vector<int>, std::vector<int>>& dissonant_intervals
-		= std::pair<std::vector<int>, std::vector<int>>{ std::vector<int>{1, 6}, std::vector<int>{} }) const;
-	void build_motion_data(Sonority& next_sonority);
-	const MotionType get_motion_type() const;
+	const bool is_sonority_dissonant(const DissonantIntervals& dissonant_intervals = default_dissonant_intervals) const;
 	const int get_num_rests() const;
 
 	const int get_index() const {
 		return m_index;
 	}
 
-	const mx::api::NoteData& get_note_1() const {
+	const CompactNote& get_note_1() const {
 		return m_note_1;
 	}
 
-	const mx::api::NoteData& get_note_2() const {
+	const CompactNote& get_note_2() const {
 		return m_note_2;
 	}
 
-	mx::api::NoteData& note_1() {
-		return m_note_1;
-	}
+	void shift_note_octave(const int voice, const int octaves);
 
-	mx::api::NoteData& note_2() {
-		return m_note_2;
-	}
+	// Results of the interval kernel, for a whole array at once. See build_interval_data() and build_motion_data()
+	void set_intervals(const Interval& signed_compound_interval, const Interval& compound_interval, const Interval& simple_interval);
+	void set_motion_data(const Interval& note_1_motion, const Interval& note_2_motion, const MotionType motion_type);
 
-	const mx::api::NoteData& get_note(const int voice) const {
+	const CompactNote& get_note(const int voice) const {
 		if (voice == 0) {
 			return m_note_1;
 		} else
@@ -57,17 +88,16 @@ public:
 		}
 	}
 
-	const Interval get_compound_interval() const {
-		return get_interval(m_note_1, m_note_2, false);
+	const Interval& get_compound_interval() const {
+		return m_compound_interval;
 	}
 
-	const Interval get_signed_compound_interval() const {
-		return get_interval(m_note_1, m_note_2, true);
+	const Interval& get_signed_compound_interval() const {
+		return m_signed_compound_interval;
 	}
 
-	const Interval get_simple_interval() const {
-		Interval interval{ get_interval(m_note_1, m_note_2, false) };
-		return Interval{ (interval.first >= 7) ? ((interval.first >= 14) ? (interval.first % 7) : (interval.first - 7)) : interval.first, (interval.second >= 12) ? ((interval.second >= 24) ? (interval.second % 12) : (interval.second - 12)) : interval.second };
+	const Interval& get_simple_interval() const {
+		return m_simple_interval;
 	}
 
 	void set_lower_voice(const int value) {
@@ -102,25 +132,60 @@ public:
 		}
 	}
 
+	const MotionType get_motion_type() const {
+		return m_motion_type;
+	}
+
 	const int get_rhythmic_hierarchy() const {
 		return m_rhythmic_hierarchy;
 	}
 
 private:
 	const int m_index{}; // FIX
-	mx::api::NoteData m_note_1{ mx::api::NoteData{} };
-	mx::api::NoteData m_note_2{ mx::api::NoteData{} };
+	CompactNote m_note_1{};
+	CompactNote m_note_2{};
 	int m_lower_voice{ -1 };
-	//const Interval m_compound_interval{ get_interval(m_note_1, m_note_2, false) };
-	//const Interval m_signed_compound_interval{ get_interval(m_note_1, m_note_2, true) }; // positive = note_1 lower
-	//const Interval m_simple_interval{ m_compound_interval.first % 7, m_compound_interval.second % 12 };
+	Interval m_compound_interval{ 0, 0 }; // Rest code (-1000) if either note is a rest
+	Interval m_signed_compound_interval{ 0, 0 }; // positive = note_1 lower
+	Interval m_simple_interval{ 0, 0 };
 	//const Interval m_signed_simple_interval{ (m_signed_compound_interval.first % 7 + 7) % 7, (m_signed_compound_interval.second % 12 + 12) % 12 }; // positive = note_1 lower
+
+	void update_intervals();
 	Interval m_note_1_motion{ 0, 0 };
 	Interval m_note_2_motion{ 0, 0 };
+	MotionType m_motion_type{ stationary };
 	int m_rhythmic_hierarchy{ 0 }; // 0 = weakest beat (tick).
+
+	friend void shift_voice_octave(std::pmr::vector<Sonority>& sonority_array, const int voice, const int octaves);
 };
 
-using SonorityArray = std::vector<Sonority>;
+using SonorityArray = std::pmr::vector<Sonority>; // Usually in the checker's scratch arena
+
+// Kernel scratch goes to the array's own memory resource
+void build_interval_data(SonorityArray& sonority_array); // Intervals of every sonority, in one pass of the interval kernel
+void build_motion_data(SonorityArray& sonority_array); // Motion from each sonority to the next. The last is stationary
+void shift_voice_octave(SonorityArray& sonority_array, const int voice, const int octaves); // Used to build the inversions
+
+// One bit per sonority of an array, built in one pass, so the rules can skip whole words of sonorities they
+// don't care about (e.g. 64 consonant sonorities at a time when looking for dissonances)
+class SonorityMasks {
+public:
+	SonorityMasks(const SonorityArray& sonority_array, const std::vector<DissonantIntervals>& dissonance_configurations);
+
+	const Bitset& get_dissonant(const DissonantIntervals& dissonant_intervals) const; // Must be one of the configurations
+	const Bitset& get_perfect_consonances() const {
+		return m_perfect_consonances;
+	}
+	const Bitset& get_rests() const {
+		return m_rests;
+	}
+
+private:
+	std::vector<DissonantIntervals> m_dissonance_configurations{};
+	std::vector<Bitset> m_dissonant{}; // Parallel to m_dissonance_configurations
+	Bitset m_perfect_consonances{}; // Unisons, fifths and octaves by semitones
+	Bitset m_rests{}; // Either note is a rest
+};
 
-const bool is_dissonant(const mx::api::NoteData& note_1, const mx::api::NoteData& note_2, const std::pair<std::vector<int>, std::vector<int>>& dissonant_intervals);
+const bool is_dissonant(const CompactNote& note_1, const CompactNote& note_2, const DissonantIntervals& dissonant_intervals);
 const bool is_identical(const Sonority& sonority_1, const Sonority& sonority_2);
\ No newline at end of file